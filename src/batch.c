@@ -0,0 +1,364 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <ctype.h>
+#include <time.h>
+
+#ifdef _arch_dreamcast
+#include <arch/timer.h>
+#endif
+
+#include "flashrom.h"
+#include "dumpfmt.h"
+#include "wear.h"
+#include "batch.h"
+#include "utils.h"
+#include "trace.h"
+
+static const struct {
+    const char *name;
+    int has_arg;
+    int needs_arming;
+} ops[] = {
+    { "armed", 0, 0 },                  /* BATCH_ARMED */
+    { "backup", 1, 0 },                 /* BATCH_BACKUP */
+    { "keys", 0, 0 },                   /* BATCH_KEYS */
+    { "scrub", 0, 1 },                  /* BATCH_SCRUB */
+    { "erase", 0, 1 },                  /* BATCH_ERASE */
+    { "restore", 1, 1 },                /* BATCH_RESTORE */
+    { "verify", 0, 0 },                 /* BATCH_VERIFY */
+    { "report", 1, 0 },                 /* BATCH_REPORT */
+    { "wipe", 0, 1 }                    /* BATCH_WIPE */
+};
+
+#define NUM_OPS (int)(sizeof(ops) / sizeof(ops[0]))
+
+static const char *states[] = { "pending", "ok", "failed", "skipped" };
+
+/* Where a backup gets loaded to before restoring it. */
+static uint8_t restore_img[FLASHROM_SIZE] __attribute__((aligned(32)));
+
+static uint32_t now_ms(void) {
+#ifdef _arch_dreamcast
+    return (uint32_t)timer_ms_gettime64();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+#endif
+}
+
+const char *batch_op_name(int op) {
+    return op >= 0 && op < NUM_OPS ? ops[op].name : "?";
+}
+
+const char *batch_state_name(int state) {
+    return state >= BATCH_PENDING && state <= BATCH_SKIPPED ? states[state] :
+        "?";
+}
+
+/* Read in a script, checking all of it before anything gets run. A script
+   that would change the flashrom without being armed first doesn't load.
+   Returns -1 if the script can't be opened, or -2 if there's something wrong
+   with it. */
+int batch_load(batch_t *b, const char *fn) {
+    char line[256], *s, *e;
+    batch_step_t *st;
+    int ln = 0, op, armed = 0;
+    FILE *fp;
+
+    memset(b, 0, sizeof(batch_t));
+    snprintf(b->name, BATCH_MAX_ARG, "%s", fn);
+
+    if(!(fp = fopen(fn, "r")))
+        return -1;
+
+    while(fgets(line, sizeof(line), fp)) {
+        ++ln;
+
+        if((s = strchr(line, '#')))
+            *s = 0;
+
+        /* Split it up into the step name and its argument, if any. */
+        for(s = line; isspace((unsigned char)*s); ++s) ;
+        for(e = s; *e && !isspace((unsigned char)*e); ++e) ;
+
+        if(e == s)
+            continue;
+
+        if(*e)
+            *e++ = 0;
+
+        for(op = 0; op < NUM_OPS && strcmp(s, ops[op].name); ++op) ;
+
+        if(op == NUM_OPS) {
+            printf("%s:%d: unknown step '%s'\n", fn, ln, s);
+            goto err;
+        }
+
+        if(b->count == BATCH_MAX_STEPS) {
+            printf("%s:%d: too many steps\n", fn, ln);
+            goto err;
+        }
+
+        if(ops[op].needs_arming && !armed) {
+            printf("%s:%d: %s needs the script to be armed first\n", fn, ln,
+                   s);
+            goto err;
+        }
+
+        st = &b->step[b->count++];
+        st->op = op;
+        armed |= op == BATCH_ARMED;
+
+        for(s = e; isspace((unsigned char)*s); ++s) ;
+        for(e = s + strlen(s); e > s && isspace((unsigned char)e[-1]); --e) ;
+        *e = 0;
+
+        if(ops[op].has_arg != (*s != 0) || strlen(s) >= BATCH_MAX_ARG) {
+            printf("%s:%d: %s %s\n", fn, ln, ops[op].name, ops[op].has_arg ?
+                   "needs a file name" : "doesn't take anything after it");
+            goto err;
+        }
+
+        strcpy(st->arg, s);
+    }
+
+    fclose(fp);
+    return 0;
+
+err:
+    fclose(fp);
+    b->count = 0;
+    return -2;
+}
+
+static int do_backup(const char *fn) {
+    FILE *fp;
+    int rv;
+
+    if(!(fp = fopen(fn, "wb"))) {
+        printf("Error opening %s\n", fn);
+        return -1;
+    }
+
+    rv = dump_write(fp, flash_read, NULL, NULL);
+
+    if(fclose(fp))
+        return -1;
+
+    return rv;
+}
+
+/* Missing keys aren't a failure here, only not being able to look. */
+static int do_keys(batch_t *b) {
+    uint8_t blk[64];
+    int rv;
+
+    rv = flash_get_block(FLASHROM_PT_BLOCK_1, FLASHROM_B1_PSOKEYS, blk);
+
+    if(rv == -1)
+        return 0;
+    else if(rv)
+        return -1;
+
+    parse_pso_keys(blk, &b->v1, &b->v2);
+    b->keys = 1;
+    return 1;
+}
+
+static int do_restore(const char *fn) {
+    flash_plan_t pl;
+    int rv;
+
+    if((rv = dump_load(fn, restore_img)) >= 0)
+        rv = flash_restore(restore_img, &pl);
+
+    return rv;
+}
+
+static int do_verify(void) {
+    uint8_t blk[64];
+
+    return flash_get_block(FLASHROM_PT_BLOCK_1, FLASHROM_B1_PSOKEYS, blk) ==
+        -1 ? 0 : -1;
+}
+
+static int do_report(const batch_t *b, const char *fn) {
+    FILE *fp;
+    int rv;
+
+    if(!(fp = fopen_append(fn))) {
+        printf("Cannot open report %s\n", fn);
+        return -1;
+    }
+
+    rv = batch_report(b, fp);
+
+    if(fclose(fp) || rv < 0) {
+        printf("Error writing report %s\n", fn);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Run a script that's been loaded. Returns 0 if every step succeeded. */
+int batch_run(batch_t *b, batch_cb_t cb, void *d) {
+    batch_step_t *st;
+    uint32_t t;
+    int i, rv;
+
+    for(i = 0; i < b->count; ++i) {
+        st = &b->step[i];
+
+        if(b->failed && st->op != BATCH_REPORT) {
+            st->state = BATCH_SKIPPED;
+
+            if(cb)
+                cb(b, i, d);
+
+            continue;
+        }
+
+        if(cb)
+            cb(b, i, d);
+
+        t = now_ms();
+
+        /* batch_load makes sure of this, but it's cheap to check again. */
+        if(ops[st->op].needs_arming && !b->armed) {
+            rv = -1;
+        }
+        else {
+            TRACE_ZONE(ops[st->op].name);
+
+            switch(st->op) {
+                case BATCH_ARMED:
+                    b->armed = 1;
+                    rv = 0;
+                    break;
+
+                case BATCH_BACKUP:
+                    rv = do_backup(st->arg);
+                    break;
+
+                case BATCH_KEYS:
+                    rv = do_keys(b);
+                    break;
+
+                case BATCH_SCRUB:
+                    rv = erase_pso_keys();
+                    break;
+
+                case BATCH_WIPE:
+                    rv = flash_scrub(SCRUB_ALL);
+                    break;
+
+                case BATCH_ERASE:
+                    rv = erase_flashrom();
+                    break;
+
+                case BATCH_RESTORE:
+                    rv = do_restore(st->arg);
+                    break;
+
+                case BATCH_VERIFY:
+                    rv = do_verify();
+                    break;
+
+                default:
+                    /* The report should show this step as done. */
+                    st->state = BATCH_OK;
+                    rv = do_report(b, st->arg);
+                    break;
+            }
+        }
+
+        st->ms = now_ms() - t;
+        st->result = rv;
+        st->state = rv < 0 ? BATCH_FAILED : BATCH_OK;
+        b->failed |= rv < 0;
+
+        if(cb)
+            cb(b, i, d);
+    }
+
+    return b->failed ? -1 : 0;
+}
+
+/* Quote a string for JSON. File names are the only thing that could have
+   anything nasty in them. */
+static int put_str(FILE *fp, const char *str) {
+    if(fputc('"', fp) == EOF)
+        return -1;
+
+    for(; *str; ++str) {
+        if((*str == '"' || *str == '\\') && fputc('\\', fp) == EOF)
+            return -1;
+
+        if(fputc(*str, fp) == EOF)
+            return -1;
+    }
+
+    return fputc('"', fp) == EOF ? -1 : 0;
+}
+
+/* Write out one line of JSON with how the script went so far. */
+int batch_report(const batch_t *b, FILE *fp) {
+    const batch_step_t *st;
+    uint32_t id = 0;
+    int i, rv = 0;
+
+    wear_console_id(&id);
+
+    fprintf(fp, "{\"script\":");
+    put_str(fp, b->name);
+    fprintf(fp, ",\"console\":\"%08" PRIX32 "\",\"time\":%lu,"
+            "\"result\":\"%s\"", id, (unsigned long)time(NULL),
+            b->failed ? "fail" : "pass");
+
+    if(b->keys)
+        fprintf(fp, ",\"pso_v1\":\"%08" PRIX32 "\",\"pso_v2\":\"%08" PRIX32
+                "\"", b->v1, b->v2);
+
+    fprintf(fp, ",\"steps\":[");
+
+    for(i = 0; i < b->count; ++i) {
+        st = &b->step[i];
+        fprintf(fp, "%s{\"step\":\"%s\",", i ? "," : "", ops[st->op].name);
+
+        if(st->arg[0]) {
+            fprintf(fp, "\"arg\":");
+            put_str(fp, st->arg);
+            fputc(',', fp);
+        }
+
+        rv = fprintf(fp, "\"state\":\"%s\",\"result\":%d,\"ms\":%" PRIu32
+                     "}", states[st->state], st->result, st->ms);
+    }
+
+    if(rv >= 0)
+        rv = fprintf(fp, "]}\n");
+
+    return rv < 0 || ferror(fp) ? -1 : 0;
+}
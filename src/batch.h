@@ -0,0 +1,87 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* A batch script is a text file with one step on each line, which are run in
+   order without waiting for anyone. Blank lines and anything after a '#' are
+   ignored. The steps are:
+     armed          Allow the steps after it to change the flashrom
+     backup file    Save a sparse dump of the flashrom
+     keys           Read the PSO serial numbers, if there are any
+     scrub          Erase the PSO serial numbers (needs armed)
+     wipe           Remove the PSO serial numbers, ISP details and game
+                    settings, but nothing else (needs armed)
+     erase          Erase the settings and Block 1 partitions (needs armed)
+     restore file   Restore the flashrom from a backup (needs armed)
+     verify         Check that there are no PSO serial numbers left
+     report file    Append the result record so far to a file
+   The first step that fails stops the script, other than report steps which
+   are always run so that failures get recorded too. The result record is one
+   line of JSON with the outcome of every step. */
+
+#define BATCH_MAX_STEPS 32
+#define BATCH_MAX_ARG   128
+
+#define BATCH_ARMED     0
+#define BATCH_BACKUP    1
+#define BATCH_KEYS      2
+#define BATCH_SCRUB     3
+#define BATCH_ERASE     4
+#define BATCH_RESTORE   5
+#define BATCH_VERIFY    6
+#define BATCH_REPORT    7
+#define BATCH_WIPE      8
+
+/* Step states. */
+#define BATCH_PENDING   0
+#define BATCH_OK        1
+#define BATCH_FAILED    2
+#define BATCH_SKIPPED   3
+
+typedef struct batch_step {
+    int op;
+    int state;
+    int result;                     /* What the step's function returned */
+    uint32_t ms;
+    char arg[BATCH_MAX_ARG];
+} batch_step_t;
+
+typedef struct batch {
+    char name[BATCH_MAX_ARG];       /* The script it came from */
+    batch_step_t step[BATCH_MAX_STEPS];
+    int count;
+    int armed;
+    int failed;
+    int keys;                       /* Whether keys were read */
+    uint32_t v1, v2;
+} batch_t;
+
+/* Called before (state pending) and after each step is run. */
+typedef void (*batch_cb_t)(const batch_t *b, int i, void *d);
+
+int batch_load(batch_t *b, const char *fn);
+int batch_run(batch_t *b, batch_cb_t cb, void *d);
+int batch_report(const batch_t *b, FILE *fp);
+const char *batch_op_name(int op);
+const char *batch_state_name(int state);
+
+#endif /* !BATCH_H */
@@ -0,0 +1,314 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <inttypes.h>
+
+#include "flashrom.h"
+#include "benchref.h"
+
+/* These are the routines from the first version of the tool, for flashbench
+   to compare against. The flashrom_* calls have been swapped for the backend
+   and the KOS block lookup has been copied in here, but otherwise they work
+   the way they always did (bugs and all). Don't "fix" them. */
+
+int ref_remove_blocks(uint16_t bn[], int bnc, uint8_t *buf, int len, int *nr) {
+    uint8_t *bitmap, *bitmap2;
+    uint8_t *b2;
+    int nremoved = 0, i, j, k, removed = 0;
+
+    /* The bitmap is stored at the end of the partition, and has to take up some
+       number of blocks. Thus, we need to figure out how many blocks/bytes it
+       takes up... The loopy math here is as follows:
+       One bit per block => 512 blocks can be represented per bitmap block
+       Each block is 64 bytes in length, thus we take the total partition
+       length, find the number of blocks, figure out how many bitmap bits that
+       would require (rounded up to an even number of blocks), and divide by
+       8 to get the length in bytes. */
+    bitmap = buf + len - ((((len >> 6) + 511) & ~511) >> 3);
+
+    /* Sanity check. */
+    if(memcmp(buf, "KATANA_FLASH____", 16)) {
+        printf("Partition dump looks bad...\n");
+        return -1;
+    }
+
+    /* This shouldn't really happen often, but just in case. */
+    if(bitmap[0] == 0xff) {
+        printf("Partition is empty, nothing to do.\n");
+        return 0;
+    }
+
+    /* Allocate our replacement buffer. */
+    if(!(b2 = malloc(len))) {
+        printf("Can't allocate buffer memory\n");
+        return -1;
+    }
+
+    /* Copy the header and clear the rest of the buffer for now. */
+    memcpy(b2, buf, 64);
+    memset(b2 + 64, 0xff, len - 64);
+    bitmap2 = b2 + len - ((((len >> 6) + 511) & ~511) >> 3);
+
+    /* This is not efficient, but it is simple and clear... */
+    for(i = 0, j = 0; i < (len >> 6) - 2; ++i) {
+        /* First, see if we've run out of blocks. */
+        if(bitmap[i >> 3] & (0x80 >> (i & 7)))
+            break;
+
+        /* No, we have a block here, so let's see if it's one we care about. */
+        removed = 0;
+
+        for(k = 0; k < bnc && !removed; ++k) {
+            if((uint16_t)(buf[(i + 1) << 6]) == bn[k]) {
+                printf("Removing block %d (%d so far): blknum: %d\n", i,
+                       nremoved + 1, bn[k]);
+                ++nremoved;
+                removed = 1;
+                break;
+            }
+        }
+
+        if(!removed) {
+            /* Nope, don't care about it, copy it over blindly. */
+            memcpy(b2 + ((j + 1) << 6), buf + ((i + 1) << 6), 64);
+            bitmap2[j >> 3] &= ~(0x80 >> (j & 7));
+            ++j;
+        }
+    }
+
+    memcpy(buf, b2, len);
+    free(b2);
+    *nr = nremoved;
+    return j + 1;
+}
+
+int ref_read_partition(int p, uint8_t **buf, int *len) {
+    int rv, offset, l;
+    uint8_t *b;
+
+    *buf = NULL;
+    *len = -1;
+
+    rv = flash_image_ops.info(p, &offset, &l);
+    if(rv) {
+        printf("Partition %d: Offset: %d, length: %d, rv: %d\n", p, offset, l, rv);
+        return -1;
+    }
+
+    if(!(b = malloc(l))) {
+        printf("Couldn't allocate buffer!\n");
+        return -1;
+    }
+
+    rv = flash_read(offset, b, l);
+    if(rv < 0) {
+        printf("Read flashrom returns %d\n", rv);
+        free(b);
+        return -1;
+    }
+
+    *buf = b;
+    *len = l;
+
+    return rv;
+}
+
+/* Bit at a time, like flashrom_calc_crc() in KOS. */
+static uint16_t ref_block_crc(const uint8_t *blk) {
+    int i, c;
+    uint16_t n = 0xFFFF;
+
+    for(i = 0; i < FLASHROM_OFFSET_CRC; ++i) {
+        n ^= blk[i] << 8;
+
+        for(c = 0; c < 8; ++c) {
+            if(n & 0x8000)
+                n = (n << 1) ^ 0x1021;
+            else
+                n = n << 1;
+        }
+    }
+
+    return ~n;
+}
+
+/* The same search that flashrom_get_block() in KOS does: read the bitmap, find
+   the end of the allocated blocks, then read backwards a block at a time until
+   one with the right number turns up. */
+static int ref_get_block(int p, uint16_t id, uint8_t blk[64]) {
+    int start, size, bmcnt, i, rv;
+    uint8_t magic[18], *bitmap;
+
+    if(flash_image_ops.info(p, &start, &size) < 0)
+        return -2;
+
+    if(flash_read(start, magic, 18) < 0)
+        return -3;
+
+    if(memcmp(magic, "KATANA_FLASH____", 16) ||
+       (magic[16] | (magic[17] << 8)) != p)
+        return -4;
+
+    bmcnt = (((size / 64) + (64 * 8) - 1) & ~(64 * 8 - 1)) / 8;
+
+    if(!(bitmap = (uint8_t *)malloc(bmcnt)))
+        return -5;
+
+    if(flash_read(start + size - bmcnt, bitmap, bmcnt) < 0) {
+        rv = -6;
+        goto out;
+    }
+
+    for(i = 0; i < bmcnt * 8; ++i) {
+        if(bitmap[i / 8] & (0x80 >> (i % 8)))
+            break;
+    }
+
+    for(--i; i >= 0; --i) {
+        if(flash_read(start + (i + 1) * 64, blk, 64) < 0) {
+            rv = -7;
+            goto out;
+        }
+
+        if((blk[0] | (blk[1] << 8)) == id)
+            break;
+    }
+
+    if(i < 0)
+        rv = -1;
+    else if(ref_block_crc(blk) != (blk[FLASHROM_OFFSET_CRC] |
+                                   (blk[FLASHROM_OFFSET_CRC + 1] << 8)))
+        rv = -8;
+    else
+        rv = 0;
+
+out:
+    free(bitmap);
+    return rv;
+}
+
+static char cod(uint8_t c) {
+    if(isprint(c))
+        return (char)c;
+    return '.';
+}
+
+int ref_find_pso_keys(uint32_t *v1, uint32_t *v2) {
+    uint8_t blk[64];
+    int rv;
+    uint32_t tmp;
+
+    /* PSO Keys are stored in block 7 in the first block allocated bank. */
+    rv = ref_get_block(FLASHROM_PT_BLOCK_1, FLASHROM_B1_PSOKEYS, blk);
+    if(rv) {
+        printf("Error finding PSO keys (%d)\n", rv);
+        return -1;
+    }
+
+    printf("Block Magic: %c%c%c%c\n", cod(blk[2]), cod(blk[3]), cod(blk[4]),
+           cod(blk[5]));
+
+    /* Check the block to see if it looks sane... */
+    if(blk[4] != (uint8_t)'1' || blk[5] != (uint8_t)'S') {
+        printf("Block looks incorrect, trying anyway...\n");
+    }
+
+    tmp = blk[14] | (blk[15] << 8) | (blk[16] << 16) | (blk[17] << 24);
+    printf("PSOv1 Key: %08" PRIX32 "\n", tmp);
+    *v1 = tmp;
+
+    tmp = blk[26] | (blk[27] << 8) | (blk[28] << 16) | (blk[29] << 24);
+    printf("PSOv2 Key: %08" PRIX32 "\n", tmp);
+    *v2 = tmp;
+
+    return 0;
+}
+
+void ref_fprint_buf(FILE *fp, const unsigned char *pkt, int len) {
+    const unsigned char *pos = pkt, *row = pkt;
+    int line = 0, type = 0;
+
+    /* Print the data both in hex and ASCII. */
+    while(pos < pkt + len) {
+        if(line == 0 && type == 0) {
+            fprintf(fp, "%04X ", (uint16_t)(pos - pkt));
+        }
+
+        if(type == 0) {
+            fprintf(fp, "%02X ", *pos);
+        }
+        else {
+            if(*pos >= 0x20 && *pos < 0x7F) {
+                fprintf(fp, "%c", *pos);
+            }
+            else {
+                fprintf(fp, ".");
+            }
+        }
+
+        ++line;
+        ++pos;
+
+        if(line == 16) {
+            if(type == 0) {
+                fprintf(fp, "\t");
+                pos = row;
+                type = 1;
+                line = 0;
+            }
+            else {
+                fprintf(fp, "\n");
+                line = 0;
+                row = pos;
+                type = 0;
+            }
+        }
+    }
+
+    /* Finish off the last row's ASCII if needed. */
+    if(len & 0x1F) {
+        /* Put spaces in place of the missing hex stuff. */
+        while(line != 16) {
+            fprintf(fp, "   ");
+            ++line;
+        }
+
+        pos = row;
+        fprintf(fp, "\t");
+
+        /* Here comes the ASCII. */
+        while(pos < pkt + len) {
+            if(*pos >= 0x20 && *pos < 0x7F) {
+                fprintf(fp, "%c", *pos);
+            }
+            else {
+                fprintf(fp, ".");
+            }
+
+            ++pos;
+        }
+
+        fprintf(fp, "\n");
+    }
+
+    fflush(fp);
+}
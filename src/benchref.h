@@ -0,0 +1,32 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BENCHREF_H
+#define BENCHREF_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* The original versions of the routines that flashbench times, kept as they
+   were (other than going through the flash backend) so that there's always
+   something to compare against. Host only. */
+int ref_remove_blocks(uint16_t bn[], int bnc, uint8_t *buf, int len, int *nr);
+int ref_read_partition(int p, uint8_t **buf, int *len);
+int ref_find_pso_keys(uint32_t *v1, uint32_t *v2);
+void ref_fprint_buf(FILE *fp, const unsigned char *pkt, int len);
+
+#endif /* !BENCHREF_H */
@@ -0,0 +1,226 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "flashrom.h"
+#include "dumpfmt.h"
+#include "crc.h"
+
+#define NUM_CHUNKS  (FLASHROM_SIZE / DUMP_CHUNK_SIZE)
+
+static const uint8_t erased[64] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+static void put16(uint8_t *b, uint16_t v) {
+    b[0] = (uint8_t)v;
+    b[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *b, uint32_t v) {
+    b[0] = (uint8_t)v;
+    b[1] = (uint8_t)(v >> 8);
+    b[2] = (uint8_t)(v >> 16);
+    b[3] = (uint8_t)(v >> 24);
+}
+
+static uint16_t get16(const uint8_t *b) {
+    return b[0] | (b[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *b) {
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+int dump_is_sparse(const uint8_t *hdr, int len) {
+    return len >= 8 && !memcmp(hdr, DUMP_MAGIC, 8);
+}
+
+/* Write out a sparse dump of the whole flashrom, reading it with rd (usually
+   flash_read). Each chunk goes out in a single write, since every write is a
+   round trip to the host over dcload. */
+int dump_write(FILE *fp, dump_read_t rd, dump_progress_t cb, void *d) {
+    static uint8_t chunk[DUMP_CHUNK_SIZE];
+    static uint8_t out[12 + DUMP_CHUNK_SIZE + 4];
+    uint32_t icrc = 0, mask[2];
+    int i, j, n, nblocks = 0;
+
+    memcpy(out, DUMP_MAGIC, 8);
+    put32(out + 8, DUMP_VERSION);
+    put32(out + 12, FLASHROM_SIZE);
+    put16(out + 16, 64);
+    put16(out + 18, DUMP_CHUNK_BLOCKS);
+    put32(out + 20, 0);
+
+    if(fwrite(out, 1, 24, fp) != 24)
+        return -1;
+
+    for(i = 0; i < NUM_CHUNKS; ++i) {
+        if(rd(i * DUMP_CHUNK_SIZE, chunk, DUMP_CHUNK_SIZE) < 0) {
+            printf("Error reading flashrom at %d\n", i * DUMP_CHUNK_SIZE);
+            return -1;
+        }
+
+        icrc = crc32(icrc, chunk, DUMP_CHUNK_SIZE);
+        mask[0] = mask[1] = 0;
+        n = 12;
+
+        for(j = 0; j < DUMP_CHUNK_BLOCKS; ++j) {
+            if(memcmp(chunk + (j << 6), erased, 64)) {
+                mask[j >> 5] |= 1U << (j & 31);
+                memcpy(out + n, chunk + (j << 6), 64);
+                n += 64;
+            }
+        }
+
+        if(n > 12) {
+            put32(out, i);
+            put32(out + 4, mask[0]);
+            put32(out + 8, mask[1]);
+            put32(out + n, crc32(0, out, n));
+            n += 4;
+            nblocks += (n - 16) >> 6;
+
+            if(fwrite(out, 1, n, fp) != (size_t)n)
+                return -1;
+        }
+
+        if(cb)
+            cb(i + 1, NUM_CHUNKS, d);
+    }
+
+    put32(out, 0xFFFFFFFF);
+    put32(out + 4, nblocks);
+    put32(out + 8, icrc);
+
+    if(fwrite(out, 1, 12, fp) != 12)
+        return -1;
+
+    return nblocks;
+}
+
+/* Read a sparse dump back into a raw image. Anything that doesn't check out is
+   rejected, so a dump that made it through here is exactly what was on the
+   console when it was made. */
+int dump_read(FILE *fp, uint8_t *img) {
+    static uint8_t rec[12 + DUMP_CHUNK_SIZE + 4];
+    uint32_t idx, mask[2];
+    int i, n, last = -1, nblocks = 0;
+
+    if(fread(rec, 1, 24, fp) != 24 || !dump_is_sparse(rec, 24)) {
+        printf("Not a sparse flashrom dump\n");
+        return -1;
+    }
+
+    if(get32(rec + 8) != DUMP_VERSION || get32(rec + 12) != FLASHROM_SIZE ||
+       get16(rec + 16) != 64 || get16(rec + 18) != DUMP_CHUNK_BLOCKS) {
+        printf("Unsupported sparse dump version or layout\n");
+        return -1;
+    }
+
+    memset(img, 0xFF, FLASHROM_SIZE);
+
+    for(;;) {
+        if(fread(rec, 1, 12, fp) != 12)
+            goto trunc;
+
+        idx = get32(rec);
+
+        if(idx == 0xFFFFFFFF)
+            break;
+
+        /* Chunks are always written in order, and only once. */
+        if((int)idx <= last || idx >= NUM_CHUNKS) {
+            printf("Bad chunk number %u in dump\n", (unsigned)idx);
+            return -1;
+        }
+
+        last = (int)idx;
+        mask[0] = get32(rec + 4);
+        mask[1] = get32(rec + 8);
+        n = __builtin_popcount(mask[0]) + __builtin_popcount(mask[1]);
+
+        if(fread(rec + 12, 1, (n << 6) + 4, fp) != (size_t)((n << 6) + 4))
+            goto trunc;
+
+        if(get32(rec + 12 + (n << 6)) != crc32(0, rec, 12 + (n << 6))) {
+            printf("CRC mismatch in chunk %u\n", (unsigned)idx);
+            return -1;
+        }
+
+        for(i = 0, n = 12; i < DUMP_CHUNK_BLOCKS; ++i) {
+            if(mask[i >> 5] & (1U << (i & 31))) {
+                memcpy(img + idx * DUMP_CHUNK_SIZE + (i << 6), rec + n, 64);
+                n += 64;
+            }
+        }
+
+        nblocks += (n - 12) >> 6;
+    }
+
+    /* The end marker comes with the block count and image CRC. */
+    if((int)get32(rec + 4) != nblocks ||
+       get32(rec + 8) != crc32(0, img, FLASHROM_SIZE)) {
+        printf("Image checksum mismatch, dump is corrupt\n");
+        return -1;
+    }
+
+    return nblocks;
+
+trunc:
+    printf("Sparse dump is truncated\n");
+    return -1;
+}
+
+/* Load a backup of the flashrom from a file, which can either be a raw 128KB
+   dump or a sparse one. Returns 1 if it was sparse, 0 if it was raw. */
+int dump_load(const char *fn, uint8_t *img) {
+    FILE *fp;
+    size_t rv;
+    int sparse;
+
+    if(!(fp = fopen(fn, "rb"))) {
+        printf("Cannot open image %s\n", fn);
+        return -1;
+    }
+
+    rv = fread(img, 1, FLASHROM_SIZE, fp);
+
+    if((sparse = dump_is_sparse(img, (int)rv))) {
+        rewind(fp);
+        rv = dump_read(fp, img) >= 0 ? FLASHROM_SIZE : 0;
+    }
+
+    fclose(fp);
+
+    if(rv != FLASHROM_SIZE) {
+        printf("Image %s is not a full flashrom dump\n", fn);
+        return -1;
+    }
+
+    return sparse;
+}
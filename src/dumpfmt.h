@@ -0,0 +1,58 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DUMPFMT_H
+#define DUMPFMT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Sparse flashrom dumps. Most of the flashrom is usually erased, so rather than
+   sending all 128KB, the image is split into 4KB chunks and only the 64 byte
+   blocks that aren't all 0xFF get stored. All values are little endian.
+
+   Header (24 bytes):
+     char magic[8]          "DCFLDUMP"
+     uint32 version         1
+     uint32 image_size      0x20000
+     uint16 block_size      64
+     uint16 chunk_blocks    64
+     uint32 reserved        0
+   Then, for each chunk that has anything in it, in order:
+     uint32 chunk           Chunk number
+     uint32 mask[2]         Bit n set if block n of the chunk is stored
+     uint8 data[]           The stored blocks, 64 bytes each
+     uint32 crc             CRC-32 of everything above, from chunk on
+   And finally:
+     uint32 end             0xFFFFFFFF
+     uint32 blocks          Total number of blocks stored
+     uint32 image_crc       CRC-32 of the whole raw image */
+
+#define DUMP_MAGIC          "DCFLDUMP"
+#define DUMP_VERSION        1
+#define DUMP_CHUNK_BLOCKS   64
+#define DUMP_CHUNK_SIZE     (DUMP_CHUNK_BLOCKS * 64)
+
+typedef int (*dump_read_t)(int offset, void *buf, int len);
+typedef void (*dump_progress_t)(int done, int total, void *d);
+
+int dump_write(FILE *fp, dump_read_t rd, dump_progress_t cb, void *d);
+int dump_read(FILE *fp, uint8_t *img);
+int dump_is_sparse(const uint8_t *hdr, int len);
+int dump_load(const char *fn, uint8_t *img);
+
+#endif /* !DUMPFMT_H */
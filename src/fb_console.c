@@ -5,85 +5,308 @@
 
 */
 
+#include <string.h>
 #include <stdarg.h>
 #include <dc/biosfont.h>
 #include <dc/video.h>
+#include <dc/sq.h>
+
+#include "fb_console.h"
+#include "trace.h"
 
 /* This is a very simple dbgio interface for doing debug to the framebuffer with
    the biosfont functionality. Basically, this was written to aid in debugging
    the network stack, and I figured other people would probably get some use out
    of it as well. */
 
+/* Everything is drawn into a back buffer in main RAM and copied out to the
+   framebuffer during vblank. The text on screen is kept as a ring of lines, so
+   scrolling just moves the start of the ring, and only the rows whose text
+   actually changed get drawn again. */
+
+#define FONT_CHAR_WIDTH 12
+#define FONT_CHAR_HEIGHT 24
+
+/* Assume we're using 640x480x16bpp */
+#define FB_W    640
+#define FB_H    480
+#define MIN_X   32
+#define MIN_Y   32
+#define MAX_X   608
+#define MAX_Y   448
+
+#define COLS    ((MAX_X - MIN_X) / FONT_CHAR_WIDTH)
+#define ROWS    ((MAX_Y - MIN_Y) / FONT_CHAR_HEIGHT)
+
+/* Size of one row of text in the framebuffer, in bytes. */
+#define ROW_BYTES   (FONT_CHAR_HEIGHT * FB_W * 2)
+
+/* Glyphs are pre-rendered once per background color, since there are only
+   ever a couple of those in use. */
+#define GLYPH_PIXELS    (FONT_CHAR_WIDTH * FONT_CHAR_HEIGHT)
+#define ATLAS_COUNT     2
+
+/* The glyphs get filled 32 bytes at a time, so every atlas in the array has to
+   start on a 32 byte boundary, not just the first one. */
+typedef struct glyph_atlas {
+    uint16 glyph[256][GLYPH_PIXELS];
+    uint16 bg;
+    int valid;
+} __attribute__((aligned(32))) glyph_atlas_t;
+
+static glyph_atlas_t atlases[ATLAS_COUNT];
+static glyph_atlas_t *atlas;
+static int atlas_next;
+
 static uint16 *fb;
-static int fb_w, fb_h;
+static uint16 bg;
 static int cur_x, cur_y;
-static int min_x, min_y, max_x, max_y;
+static int top;
+
+/* The text of each line, in a ring starting at top, and what's actually been
+   drawn for each screen row in the back buffer. A 0 is a blank cell. */
+static char lines[ROWS][COLS];
+static char shown[ROWS][COLS];
+
+/* Rows of the back buffer that need to go out on the next flip. */
+static uint32 flip_rows;
+static int flip_all;
 
-/* I don't think this is in a header anywhere any more. */
-extern void *memcpy2(void *dest, const void *src, uint32 count);
-extern void *memset2(void *s, unsigned short c, uint32 count);
+static uint16 back[FB_W * FB_H] __attribute__((aligned(32)));
 
 /* Bleh. */
 int vsprintf(char *s, const char *format, va_list ap);
 
-#define FONT_CHAR_WIDTH 12
-#define FONT_CHAR_HEIGHT 24
+/* Fill count bytes at s with the color c, 32 bytes at a time. Both s and count
+   must be multiples of 32. */
+static void fb_fill(uint16 *s, uint16 c, uint32 count) {
+    uint32 *d = (uint32 *)s;
+    uint32 v = (c << 16) | c;
+
+    for(count >>= 5; count; --count) {
+        d[0] = v;
+        d[1] = v;
+        d[2] = v;
+        d[3] = v;
+        d[4] = v;
+        d[5] = v;
+        d[6] = v;
+        d[7] = v;
+        d += 8;
+    }
+}
+
+static uint16 *row_ptr(uint16 *buf, int row) {
+    return buf + (MIN_Y + row * FONT_CHAR_HEIGHT) * FB_W;
+}
+
+/* Find (or build) the glyphs for the current background color. Only the
+   printable ISO-8859-1 characters get drawn, everything else is left blank. */
+static void select_atlas(void) {
+    glyph_atlas_t *a;
+    int i, c;
+
+    for(i = 0; i < ATLAS_COUNT; ++i) {
+        if(atlases[i].valid && atlases[i].bg == bg) {
+            atlas = &atlases[i];
+            return;
+        }
+    }
+
+    a = &atlases[atlas_next];
+    atlas_next = (atlas_next + 1) % ATLAS_COUNT;
+
+    fb_fill(a->glyph[0], bg, sizeof(a->glyph));
+
+    for(c = 0x20; c < 0x100; ++c) {
+        if(c < 0x7F || c >= 0xA0)
+            bfont_draw(a->glyph[c], FONT_CHAR_WIDTH, 0, c);
+    }
+
+    a->bg = bg;
+    a->valid = 1;
+    atlas = a;
+}
+
+/* Copy a glyph out of the atlas. Glyphs are 12 pixels wide, and always start
+   on an even pixel, so each line is six 32-bit copies. */
+static void draw_glyph(uint16 *t, int c) {
+    const uint32 *s = (const uint32 *)atlas->glyph[c];
+    uint32 *d = (uint32 *)t;
+    int y;
+
+    for(y = 0; y < FONT_CHAR_HEIGHT; ++y) {
+        d[0] = s[0];
+        d[1] = s[1];
+        d[2] = s[2];
+        d[3] = s[3];
+        d[4] = s[4];
+        d[5] = s[5];
+        s += FONT_CHAR_WIDTH / 2;
+        d += FB_W / 2;
+    }
+}
+
+static void draw_row(int row, const char *text) {
+    uint16 *t = row_ptr(back, row);
+    int i;
+
+    fb_fill(t, bg, ROW_BYTES);
+
+    for(i = 0; i < COLS; ++i) {
+        if(text[i])
+            draw_glyph(t + MIN_X + i * FONT_CHAR_WIDTH, (uint8)text[i]);
+    }
+
+    memcpy(shown[row], text, COLS);
+    flip_rows |= 1 << row;
+}
 
 int fb_init(void) {
     bfont_set_encoding(BFONT_CODE_ISO8859_1);
+    select_atlas();
 
-    /* Assume we're using 640x480x16bpp */
     fb = NULL;
-    fb_w = 640;
-    fb_h = 480;
-    min_x = 32;
-    min_y = 32;
-    max_x = 608;
-    max_y = 448;
-    cur_x = 32;
-    cur_y = 32;
+    cur_x = 0;
+    cur_y = 0;
+    top = 0;
+    memset(lines, 0, sizeof(lines));
+    memset(shown, 0, sizeof(shown));
 
     return 0;
 }
 
-static int fb_write(int c) {
+/* Copy anything that's changed out to the framebuffer, waiting for vblank
+   first so that it doesn't tear. */
+void fb_flush(void) {
     uint16 *t = fb;
+    int i;
 
     if(!t)
         t = vram_s;
 
+    if(!flip_all && !flip_rows)
+        return;
+
+    /* Only time the flushes that actually wait and copy something. */
+    TRACE_ZONE("fb_flush");
+    vid_waitvbl();
+
+    if(flip_all) {
+        sq_cpy(t, back, FB_W * FB_H * 2);
+    }
+    else {
+        for(i = 0; i < ROWS; ++i) {
+            if(flip_rows & (1 << i))
+                sq_cpy(row_ptr(t, i), row_ptr(back, i), ROW_BYTES);
+        }
+    }
+
+    flip_all = 0;
+    flip_rows = 0;
+}
+
+void fb_clear(uint16 color) {
+    bg = color;
+
+    /* fb_init picks the right set of glyphs for the new color. */
+    fb_init();
+    fb_fill(back, bg, FB_W * FB_H * 2);
+    flip_all = 1;
+    fb_flush();
+}
+
+/* Move down a line. If that would put us over the edge of the screen, move
+   everything up a line by rotating the ring, then redraw whatever rows don't
+   match what they showed before. */
+static void fb_newline(void) {
+    int i;
+
+    cur_x = 0;
+
+    if(++cur_y == ROWS) {
+        cur_y = ROWS - 1;
+        memset(lines[top], 0, COLS);
+        top = (top + 1) % ROWS;
+
+        for(i = 0; i < ROWS; ++i) {
+            if(memcmp(lines[(top + i) % ROWS], shown[i], COLS))
+                draw_row(i, lines[(top + i) % ROWS]);
+        }
+    }
+}
+
+/* Go back to the start of the line, wiping out whatever was on it. This is
+   mostly for things like progress counters that update in place. */
+static void fb_return(void) {
+    memset(lines[(top + cur_y) % ROWS], 0, COLS);
+    draw_row(cur_y, lines[(top + cur_y) % ROWS]);
+    cur_x = 0;
+}
+
+static int fb_write(int c) {
+    if(c == '\r') {
+        fb_return();
+        return 1;
+    }
+
     if(c != '\n') {
-        bfont_draw(t + cur_y * fb_w + cur_x, fb_w, 0, c);
-        cur_x += FONT_CHAR_WIDTH;
+        lines[(top + cur_y) % ROWS][cur_x] = (char)c;
+        shown[cur_y][cur_x] = (char)c;
+        draw_glyph(row_ptr(back, cur_y) + MIN_X + cur_x * FONT_CHAR_WIDTH, c);
+        flip_rows |= 1 << cur_y;
+        ++cur_x;
     }
 
     /* If we have a newline or we've gone past the end of the line, advance down
        one line. */
-    if(c == '\n' || cur_x + FONT_CHAR_WIDTH > max_x) {
-        cur_y += FONT_CHAR_HEIGHT;
-        cur_x = min_x;
-
-        /* If going down a line put us over the edge of the screen, move
-           everything up a line, fixing the problem. */
-        if(cur_y + FONT_CHAR_HEIGHT > max_y) {
-            memcpy2(t + min_y * fb_w, t + (min_y + FONT_CHAR_HEIGHT) * fb_w,
-                    (cur_y - min_y - FONT_CHAR_HEIGHT) * fb_w * 2);
-            cur_y -= FONT_CHAR_HEIGHT;
-            memset2(t + cur_y * fb_w, 0x0010, FONT_CHAR_HEIGHT * fb_w * 2);
-        }
-    }
+    if(c == '\n' || cur_x == COLS)
+        fb_newline();
 
     return 1;
 }
 
+/* Write out a whole run of characters at a time, up to the next newline (or
+   carriage return) or the end of the current line, whichever comes first. */
 int fb_write_string(const char *data) {
-    int rv = 0;
+    TRACE_ZONE("fb_write_string");
+    const uint8 *s = (const uint8 *)data;
+    uint16 *t;
+    int rv = 0, n, i;
+
+    while(*s) {
+        if(*s == '\n' || *s == '\r') {
+            if(*s == '\n')
+                fb_newline();
+            else
+                fb_return();
+
+            ++s;
+            ++rv;
+            continue;
+        }
+
+        for(n = 0; n < COLS - cur_x && s[n] && s[n] != '\n' && s[n] != '\r';
+            ++n) ;
+
+        memcpy(lines[(top + cur_y) % ROWS] + cur_x, s, n);
+        memcpy(shown[cur_y] + cur_x, s, n);
+        t = row_ptr(back, cur_y) + MIN_X + cur_x * FONT_CHAR_WIDTH;
+
+        for(i = 0; i < n; ++i, t += FONT_CHAR_WIDTH) {
+            draw_glyph(t, s[i]);
+        }
+
+        flip_rows |= 1 << cur_y;
+        cur_x += n;
+        s += n;
+        rv += n;
 
-    while(*data) {
-        fb_write((int)(*data++));
-        ++rv;
+        if(cur_x == COLS)
+            fb_newline();
     }
 
+    fb_flush();
     return rv;
 }
 
@@ -97,5 +320,6 @@ int fb_write_hex(uint32 val) {
         shift -= 4;
     }
 
+    fb_flush();
     return 8;
 }
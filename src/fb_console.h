@@ -2,6 +2,8 @@
 #define FB_CONSOLE_H
 
 int fb_init(void);
+void fb_clear(uint16 color);
+void fb_flush(void);
 int fb_write_string(const char *data);
 int fb_write_hex(uint32 val);
 
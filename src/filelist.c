@@ -0,0 +1,125 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "filelist.h"
+
+/* Collecting up the names of a bunch of flashrom dumps to work on, for the host
+   tools that work on a lot of them at once. */
+
+int filelist_add_file(filelist_t *s, const char *fn) {
+    char **tmp;
+
+    if(s->count == s->max) {
+        s->max = s->max ? s->max * 2 : 256;
+
+        if(!(tmp = (char **)realloc(s->files, s->max * sizeof(char *)))) {
+            printf("Out of memory\n");
+            return -1;
+        }
+
+        s->files = tmp;
+    }
+
+    if(!(s->files[s->count] = strdup(fn))) {
+        printf("Out of memory\n");
+        return -1;
+    }
+
+    ++s->count;
+    return 0;
+}
+
+/* Add a file, or everything under a directory (other than dot files). */
+int filelist_add_path(filelist_t *s, const char *path) {
+    DIR *d;
+    struct dirent *ent;
+    struct stat st;
+    char fn[4096];
+    int rv = 0;
+
+    if(stat(path, &st)) {
+        fprintf(stderr, "Cannot stat %s\n", path);
+        return -1;
+    }
+
+    if(!S_ISDIR(st.st_mode))
+        return filelist_add_file(s, path);
+
+    if(!(d = opendir(path))) {
+        fprintf(stderr, "Cannot open directory %s\n", path);
+        return -1;
+    }
+
+    while(!rv && (ent = readdir(d))) {
+        if(ent->d_name[0] == '.')
+            continue;
+
+        snprintf(fn, sizeof(fn), "%s/%s", path, ent->d_name);
+        rv = filelist_add_path(s, fn);
+    }
+
+    closedir(d);
+    return rv;
+}
+
+/* Add every path listed in a file, one per line, or stdin if list is "-". */
+int filelist_add_list(filelist_t *s, const char *list) {
+    FILE *fp;
+    char line[4096];
+    size_t l;
+    int rv = 0;
+
+    if(!strcmp(list, "-"))
+        fp = stdin;
+    else if(!(fp = fopen(list, "r"))) {
+        fprintf(stderr, "Cannot open file list %s\n", list);
+        return -1;
+    }
+
+    while(!rv && fgets(line, sizeof(line), fp)) {
+        l = strlen(line);
+
+        while(l && (line[l - 1] == '\n' || line[l - 1] == '\r'))
+            line[--l] = 0;
+
+        if(l)
+            rv = filelist_add_path(s, line);
+    }
+
+    if(fp != stdin)
+        fclose(fp);
+
+    return rv;
+}
+
+void filelist_free(filelist_t *s) {
+    int i;
+
+    for(i = 0; i < s->count; ++i) {
+        free(s->files[i]);
+    }
+
+    free(s->files);
+    s->files = NULL;
+    s->count = s->max = 0;
+}
@@ -0,0 +1,33 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FILELIST_H
+#define FILELIST_H
+
+/* A growable list of file names (host only). Start with it zeroed out. */
+typedef struct filelist {
+    char **files;
+    int count;
+    int max;
+} filelist_t;
+
+int filelist_add_file(filelist_t *s, const char *fn);
+int filelist_add_path(filelist_t *s, const char *path);
+int filelist_add_list(filelist_t *s, const char *list);
+void filelist_free(filelist_t *s);
+
+#endif /* !FILELIST_H */
@@ -0,0 +1,159 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "flashrom.h"
+#include "dumpfmt.h"
+
+/* Backend that works on a raw 128KB dump of the flashrom, like the one the
+   debug menu writes out to /pc/tmp/dc_flash.bin. The partitions on the console
+   each live in their own sector of the flash chip, so the table here doubles
+   as the erase sector map. Writes behave like they do on the real chip, in
+   that they can only clear bits. */
+
+static const struct {
+    int offset;
+    int len;
+} parts[] = {
+    { 0x1A000, 0x02000 },               /* FLASHROM_PT_SYSTEM */
+    { 0x18000, 0x02000 },               /* FLASHROM_PT_RESERVED */
+    { 0x1C000, 0x04000 },               /* FLASHROM_PT_BLOCK_1 */
+    { 0x10000, 0x08000 },               /* FLASHROM_PT_SETTINGS */
+    { 0x00000, 0x10000 }                /* FLASHROM_PT_BLOCK_2 */
+};
+
+#define NUM_PARTS (int)(sizeof(parts) / sizeof(parts[0]))
+
+static uint8_t image[FLASHROM_SIZE];
+static int loaded = 0;
+static int sparse = 0;
+
+static int image_read(int offset, void *buf, int len);
+
+/* Load up an image, either a raw dump or a sparse one (see dumpfmt.h). */
+int flash_image_load(const char *fn) {
+    int rv = dump_load(fn, image);
+
+    loaded = rv >= 0;
+    sparse = rv > 0;
+    return loaded ? 0 : -1;
+}
+
+/* Use a raw image that's already in memory, as if it had been loaded from a
+   raw dump. */
+int flash_image_set(const uint8_t *img) {
+    memcpy(image, img, FLASHROM_SIZE);
+    sparse = 0;
+    loaded = 1;
+    return 0;
+}
+
+/* Save the image back out, in the same format that it was loaded in. */
+int flash_image_save(const char *fn) {
+    return flash_image_save_as(fn, sparse);
+}
+
+int flash_image_save_as(const char *fn, int as_sparse) {
+    FILE *fp;
+    int ok;
+
+    if(!loaded)
+        return -1;
+
+    if(!(fp = fopen(fn, "wb"))) {
+        printf("Cannot open %s for writing\n", fn);
+        return -1;
+    }
+
+    if(as_sparse)
+        ok = dump_write(fp, image_read, NULL, NULL) >= 0;
+    else
+        ok = fwrite(image, 1, FLASHROM_SIZE, fp) == FLASHROM_SIZE;
+
+    if(fclose(fp) || !ok) {
+        printf("Error writing image %s\n", fn);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int image_info(int part, int *offset, int *len) {
+    if(part < 0 || part >= NUM_PARTS)
+        return -1;
+
+    *offset = parts[part].offset;
+    *len = parts[part].len;
+    return 0;
+}
+
+static int image_read(int offset, void *buf, int len) {
+    if(!loaded || offset < 0 || len < 0 || offset + len > FLASHROM_SIZE)
+        return -1;
+
+    memcpy(buf, image + offset, len);
+    return 0;
+}
+
+static int image_write(int offset, const void *buf, int len) {
+    const uint8_t *b = (const uint8_t *)buf;
+    int i;
+
+    if(!loaded || offset < 0 || len < 0 || offset + len > FLASHROM_SIZE)
+        return -1;
+
+    for(i = 0; i < len; ++i) {
+        image[offset + i] &= b[i];
+    }
+
+    return len;
+}
+
+static int image_erase(int offset) {
+    int i;
+
+    if(!loaded)
+        return -1;
+
+    for(i = 0; i < NUM_PARTS; ++i) {
+        if(offset >= parts[i].offset &&
+           offset < parts[i].offset + parts[i].len) {
+            memset(image + parts[i].offset, 0xFF, parts[i].len);
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static const uint8_t *image_map(int offset, int len) {
+    if(!loaded || offset < 0 || len < 0 || offset + len > FLASHROM_SIZE)
+        return NULL;
+
+    return image + offset;
+}
+
+const flash_ops_t flash_image_ops = {
+    image_info,
+    image_read,
+    image_write,
+    image_erase,
+    image_map
+};
@@ -0,0 +1,48 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+
+#include <dc/flashrom.h>
+
+#include "flashrom.h"
+
+/* The console backend just hands everything off to the BIOS flashrom syscalls
+   by way of KOS, other than reads that can go straight to the flashrom. */
+
+/* The flashrom shows up in memory at 0x00200000. Go through the uncached
+   mirror of it, so that nothing stale is left in the cache after a write. */
+#define FLASHROM_MAP    0xA0200000
+
+static int kos_write(int offset, const void *buf, int len) {
+    return flashrom_write(offset, (void *)buf, len);
+}
+
+static const uint8_t *kos_map(int offset, int len) {
+    if(offset < 0 || len < 0 || offset + len > FLASHROM_SIZE)
+        return NULL;
+
+    return (const uint8_t *)(uintptr_t)(FLASHROM_MAP + offset);
+}
+
+const flash_ops_t flash_kos_ops = {
+    flashrom_info,
+    flashrom_read,
+    kos_write,
+    flashrom_delete,
+    kos_map
+};
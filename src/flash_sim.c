@@ -0,0 +1,226 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "flashrom.h"
+
+/* Backend that stands in for the flash chip itself, for trying out what the
+   engine does to the flash without wearing out a real console. It's stricter
+   than the image backend: a program that tries to take a bit from 0 back to 1
+   fails (after clearing whatever bits it could, like the chip does), erases
+   take out the whole sector, and it keeps count of everything done to each
+   sector. Each operation costs a configurable amount of time, which is added
+   up and optionally actually waited out. Power can be made to fail part way
+   through any program or erase, after which everything fails until power is
+   restored. The sectors are the same as the partitions in the image backend. */
+
+#define NUM_SECTORS (FLASHROM_PT_BLOCK_2 + 1)
+
+static uint8_t chip[FLASHROM_SIZE];
+static int loaded = 0;
+
+/* Typical figures from the datasheets for 29LV series flash parts like the one
+   in the Dreamcast. Reads are left free. */
+static flash_sim_timing_t timing = { 0, 9000, 700000, 0 };
+
+static flash_sim_stats_t stats;
+static uint32_t cut_at = 0;
+static int powered = 1;
+
+static int sector_of(int offset, int *start, int *len) {
+    int s;
+
+    for(s = 0; s < NUM_SECTORS; ++s) {
+        if(!flash_image_ops.info(s, start, len) && offset >= *start &&
+           offset < *start + *len)
+            return s;
+    }
+
+    return -1;
+}
+
+/* Account for the time an operation keeps the chip busy. */
+static void busy(uint64_t ns) {
+    struct timespec ts;
+
+    stats.busy_ns += ns;
+
+    if(timing.realtime && ns) {
+        ts.tv_sec = (time_t)(ns / 1000000000);
+        ts.tv_nsec = (long)(ns % 1000000000);
+        nanosleep(&ts, NULL);
+    }
+}
+
+/* Called at the start of every program and erase. Returns nonzero if this is
+   the one that the power goes out during. */
+static int power_fails(void) {
+    if(!cut_at)
+        return 0;
+
+    if(--cut_at)
+        return 0;
+
+    powered = 0;
+    return 1;
+}
+
+static int sim_info(int part, int *offset, int *len) {
+    return flash_image_ops.info(part, offset, len);
+}
+
+static int sim_read(int offset, void *buf, int len) {
+    if(!loaded || !powered || offset < 0 || len < 0 ||
+       offset + len > FLASHROM_SIZE)
+        return -1;
+
+    memcpy(buf, chip + offset, len);
+    ++stats.reads;
+    stats.read_bytes += len;
+    busy((uint64_t)timing.read_ns * len);
+    return 0;
+}
+
+static int sim_write(int offset, const void *buf, int len) {
+    const uint8_t *b = (const uint8_t *)buf;
+    int i, end, s, start, slen, n = len, refused = 0;
+    uint8_t old;
+
+    if(!loaded || !powered || offset < 0 || len < 0 ||
+       offset + len > FLASHROM_SIZE)
+        return -1;
+
+    /* Losing power part way through leaves the first half programmed. */
+    if(power_fails())
+        n = len / 2;
+
+    /* Go a sector at a time, so that each one gets credited with its own part
+       of a write that crosses into the next. */
+    for(i = 0; i < n; i = end) {
+        if((s = sector_of(offset + i, &start, &slen)) < 0)
+            return -1;
+
+        end = start + slen - offset;
+
+        if(end > n)
+            end = n;
+
+        stats.programmed[s] += end - i;
+
+        for(; i < end; ++i) {
+            old = chip[offset + i];
+
+            if(b[i] & ~old)
+                refused = 1;
+
+            chip[offset + i] = old & b[i];
+            stats.cleared[s] += __builtin_popcount(old & ~b[i]);
+        }
+    }
+
+    ++stats.programs;
+    busy((uint64_t)timing.program_ns * n);
+
+    if(!powered)
+        return -1;
+
+    if(refused) {
+        ++stats.refused;
+        return -1;
+    }
+
+    return len;
+}
+
+static int sim_erase(int offset) {
+    int s, start, len;
+
+    if(!loaded || !powered || (s = sector_of(offset, &start, &len)) < 0)
+        return -1;
+
+    /* What's left after losing power during an erase is anyone's guess. Call
+       it the first half of the sector erased and the rest untouched. */
+    if(power_fails())
+        len /= 2;
+
+    memset(chip + start, 0xFF, len);
+    ++stats.erases[s];
+    busy((uint64_t)timing.erase_us * 1000);
+
+    return powered ? 0 : -1;
+}
+
+static const uint8_t *sim_map(int offset, int len) {
+    if(!loaded || !powered || offset < 0 || len < 0 ||
+       offset + len > FLASHROM_SIZE)
+        return NULL;
+
+    return chip + offset;
+}
+
+const flash_ops_t flash_sim_ops = {
+    sim_info,
+    sim_read,
+    sim_write,
+    sim_erase,
+    sim_map
+};
+
+/* Put the given raw image on the simulated chip, with the power on. */
+int flash_sim_set(const uint8_t *img) {
+    memcpy(chip, img, FLASHROM_SIZE);
+    loaded = 1;
+    powered = 1;
+    cut_at = 0;
+    return 0;
+}
+
+/* What's on the chip right now, whether the power's on or not. */
+const uint8_t *flash_sim_image(void) {
+    return loaded ? chip : NULL;
+}
+
+void flash_sim_set_timing(const flash_sim_timing_t *t) {
+    timing = *t;
+}
+
+/* Make the power go out during the nth program or erase from now on. Zero
+   means never. */
+void flash_sim_power_cut(uint32_t n) {
+    cut_at = n;
+}
+
+int flash_sim_powered(void) {
+    return powered;
+}
+
+void flash_sim_power_on(void) {
+    powered = 1;
+    cut_at = 0;
+}
+
+void flash_sim_get_stats(flash_sim_stats_t *st) {
+    *st = stats;
+}
+
+void flash_sim_reset_stats(void) {
+    memset(&stats, 0, sizeof(stats));
+}
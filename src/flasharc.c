@@ -0,0 +1,934 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "flashrom.h"
+#include "partidx.h"
+#include "dumpfmt.h"
+#include "crc.h"
+#include "pool.h"
+#include "filelist.h"
+
+/* Deduplicating archive for lots of flashrom dumps (host only). Dumps from
+   different consoles are mostly the same, so rather than keeping each 128KB
+   image around, an archive keeps each distinct 64 byte block once, each
+   distinct partition once (as a list of references to blocks), and each image
+   as a name, a CRC and five references to partitions. An archive is a
+   directory with three files in it, all of which are only ever appended to:
+
+   blocks.dat   "DCFABLK1" padded out to 64 bytes, then the blocks. Block n is
+                at offset (n + 1) * 64. Blank (all 0xFF) blocks are never
+                stored, and are referred to as ARC_ERASED.
+   parts.dat    "DCFAPRT1", then partition records, each of which is:
+                  uint8 part        Partition number
+                  uint8 packed      See below
+                  uint16 reserved
+                  uint32 nrefs
+                  uint32 refs[nrefs]
+                Partitions are referred to by the offset of their record from
+                the end of the magic.
+   images.dat   "DCFAIMG1", then image records, each of which is:
+                  uint16 namelen
+                  uint16 reserved
+                  uint32 crc        CRC-32 of the raw image
+                  uint32 parts[5]   Indexed by partition number
+                  char name[namelen]
+
+   A partition that has a valid header and nothing but blank space between its
+   last allocated block and the bitmap is packed: its references are just the
+   header, the allocated block slots and the bitmap, and the rest is known to
+   be blank. Anything else refers to every 64 byte block of the partition. All
+   values are little endian. */
+
+#define ARC_ERASED      0xFFFFFFFF
+#define NUM_PARTS       (FLASHROM_PT_BLOCK_2 + 1)
+#define IMG_BLOCKS      (FLASHROM_SIZE / 64)
+#define BATCH           256
+
+typedef struct image_rec {
+    char *name;
+    uint32_t crc;
+    uint32_t parts[NUM_PARTS];
+} image_rec_t;
+
+typedef struct arc {
+    const char *dir;
+
+    /* Every stored block, and a hash table of (index + 1) into them. */
+    uint8_t *blocks;
+    uint32_t nblocks, maxblocks;
+    uint32_t *btab, bsize;
+
+    /* The contents of parts.dat (after the magic), and a hash table of (record
+       offset + 1) into it. */
+    uint8_t *parts;
+    uint32_t plen, pmax, nparts;
+    uint32_t *ptab, psize;
+
+    image_rec_t *images;
+    int nimages;
+    uint32_t maximages;
+
+    FILE *bfp, *pfp, *ifp;
+} arc_t;
+
+static const uint8_t erased[64] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+static void put32(uint8_t *b, uint32_t v) {
+    b[0] = (uint8_t)v;
+    b[1] = (uint8_t)(v >> 8);
+    b[2] = (uint8_t)(v >> 16);
+    b[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get32(const uint8_t *b) {
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+/* 64-bit FNV-1a. Hashes are only used to find candidates, and the contents are
+   always compared before anything is treated as a duplicate. */
+static uint64_t hash(const uint8_t *buf, int len) {
+    uint64_t h = 14695981039346656037ULL;
+    int i;
+
+    for(i = 0; i < len; ++i) {
+        h = (h ^ buf[i]) * 1099511628211ULL;
+    }
+
+    return h;
+}
+
+/* Hash tables are a power of two in size, and kept at most half full. */
+static uint32_t table_size(uint32_t n) {
+    uint32_t size = 1024;
+
+    while(size < n * 2)
+        size *= 2;
+
+    return size;
+}
+
+static int grow(void **p, uint32_t *max, uint32_t need, size_t sz) {
+    uint32_t n = *max ? *max : 1024;
+    void *tmp;
+
+    if(need <= *max)
+        return 0;
+
+    while(n < need)
+        n *= 2;
+
+    if(!(tmp = realloc(*p, (size_t)n * sz))) {
+        printf("Out of memory\n");
+        return -1;
+    }
+
+    *p = tmp;
+    *max = n;
+    return 0;
+}
+
+/* Find a block in the archive, given its hash. Returns its index (or
+   ARC_ERASED for a blank block) if it's there, otherwise -1 minus the slot in
+   the hash table that it should go in. */
+static int64_t block_ref(arc_t *a, const uint8_t *blk, uint64_t h) {
+    uint32_t i, n;
+
+    if(!memcmp(blk, erased, 64))
+        return ARC_ERASED;
+
+    for(i = (uint32_t)h & (a->bsize - 1); (n = a->btab[i]);
+        i = (i + 1) & (a->bsize - 1)) {
+        if(!memcmp(a->blocks + (size_t)(n - 1) * 64, blk, 64))
+            return n - 1;
+    }
+
+    return -1 - (int64_t)i;
+}
+
+static int block_table(arc_t *a, uint32_t size) {
+    uint32_t i, j;
+
+    free(a->btab);
+
+    if(!(a->btab = (uint32_t *)calloc(size, sizeof(uint32_t)))) {
+        printf("Out of memory\n");
+        return -1;
+    }
+
+    a->bsize = size;
+
+    for(i = 0; i < a->nblocks; ++i) {
+        j = (uint32_t)hash(a->blocks + (size_t)i * 64, 64) & (size - 1);
+
+        while(a->btab[j])
+            j = (j + 1) & (size - 1);
+
+        a->btab[j] = i + 1;
+    }
+
+    return 0;
+}
+
+static int64_t add_block(arc_t *a, const uint8_t *blk, uint64_t h) {
+    int64_t r = block_ref(a, blk, h);
+
+    if(r >= 0)
+        return r;
+
+    if(grow((void **)&a->blocks, &a->maxblocks, a->nblocks + 1, 64) ||
+       fwrite(blk, 1, 64, a->bfp) != 64)
+        return -1;
+
+    memcpy(a->blocks + (size_t)a->nblocks * 64, blk, 64);
+    a->btab[-1 - r] = ++a->nblocks;
+
+    /* Keep the table at most half full. */
+    if(a->nblocks * 2 > a->bsize && block_table(a, a->bsize * 2))
+        return -1;
+
+    return a->nblocks - 1;
+}
+
+static uint32_t part_reclen(const uint8_t *rec) {
+    return 8 + get32(rec + 4) * 4;
+}
+
+static int part_table(arc_t *a, uint32_t size) {
+    uint32_t off, j;
+
+    free(a->ptab);
+
+    if(!(a->ptab = (uint32_t *)calloc(size, sizeof(uint32_t)))) {
+        printf("Out of memory\n");
+        return -1;
+    }
+
+    a->psize = size;
+
+    for(off = 0; off < a->plen; off += part_reclen(a->parts + off)) {
+        j = (uint32_t)hash(a->parts + off, part_reclen(a->parts + off)) &
+            (size - 1);
+
+        while(a->ptab[j])
+            j = (j + 1) & (size - 1);
+
+        a->ptab[j] = off + 1;
+    }
+
+    return 0;
+}
+
+static int64_t add_part(arc_t *a, const uint8_t *rec) {
+    uint32_t len = part_reclen(rec), i, n;
+
+    for(i = (uint32_t)hash(rec, len) & (a->psize - 1); (n = a->ptab[i]);
+        i = (i + 1) & (a->psize - 1)) {
+        if(part_reclen(a->parts + n - 1) == len &&
+           !memcmp(a->parts + n - 1, rec, len))
+            return n - 1;
+    }
+
+    if(grow((void **)&a->parts, &a->pmax, a->plen + len, 1) ||
+       fwrite(rec, 1, len, a->pfp) != len)
+        return -1;
+
+    memcpy(a->parts + a->plen, rec, len);
+    a->ptab[i] = a->plen + 1;
+    a->plen += len;
+
+    if(++a->nparts * 2 > a->psize && part_table(a, a->psize * 2))
+        return -1;
+
+    return a->plen - len;
+}
+
+/* Read in one of the archive's files, checking its magic and getting rid of
+   anything at the end that was only partly written. A missing file is only
+   started off new when create is set. */
+static uint8_t *load_file(const char *dir, const char *fn, const char *magic,
+                          int hlen, int create, uint32_t *len, FILE **fp) {
+    char path[4096];
+    uint8_t *buf = NULL, hdr[64];
+    struct stat st;
+    long l;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, fn);
+
+    /* Start off a new file if there isn't one yet. */
+    if(stat(path, &st)) {
+        if(!create) {
+            printf("No archive at %s\n", dir);
+            return NULL;
+        }
+
+        memset(hdr, 0, hlen);
+        memcpy(hdr, magic, 8);
+
+        if(!(*fp = fopen(path, "w+b")) ||
+           fwrite(hdr, 1, hlen, *fp) != (size_t)hlen) {
+            printf("Cannot create %s\n", path);
+            return NULL;
+        }
+
+        *len = 0;
+        return (uint8_t *)malloc(1);
+    }
+
+    if(!(*fp = fopen(path, "r+b"))) {
+        printf("Cannot open %s\n", path);
+        return NULL;
+    }
+
+    fseek(*fp, 0, SEEK_END);
+    l = ftell(*fp) - hlen;
+    rewind(*fp);
+
+    if(l < 0 || fread(hdr, 1, hlen, *fp) != (size_t)hlen ||
+       memcmp(hdr, magic, 8) || !(buf = (uint8_t *)malloc(l + 1)) ||
+       fread(buf, 1, l, *fp) != (size_t)l) {
+        printf("%s is not part of a flash archive\n", path);
+        free(buf);
+        return NULL;
+    }
+
+    *len = (uint32_t)l;
+    return buf;
+}
+
+static int trim_file(const char *dir, const char *fn, FILE *fp, long len) {
+    char path[4096];
+
+    fflush(fp);
+    snprintf(path, sizeof(path), "%s/%s", dir, fn);
+
+    if(truncate(path, len)) {
+        printf("Cannot trim %s\n", path);
+        return -1;
+    }
+
+    return fseek(fp, 0, SEEK_END);
+}
+
+static int arc_open(arc_t *a, const char *dir, int create) {
+    uint8_t *imgs;
+    uint32_t len, off, nl;
+    image_rec_t *r;
+    char *name;
+    int i;
+
+    memset(a, 0, sizeof(arc_t));
+    a->dir = dir;
+
+    if(create)
+        mkdir(dir, 0777);
+
+    /* Blocks. */
+    if(!(a->blocks = load_file(dir, "blocks.dat", "DCFABLK1", 64, create,
+                               &len, &a->bfp)))
+        return -1;
+
+    a->nblocks = a->maxblocks = len / 64;
+
+    if((len & 63) && trim_file(dir, "blocks.dat", a->bfp, 64 + (len & ~63)))
+        return -1;
+
+    if(block_table(a, table_size(a->nblocks)))
+        return -1;
+
+    /* Partitions. Anything that refers past the end of the blocks must not
+       have made it out completely, so stop there. */
+    if(!(a->parts = load_file(dir, "parts.dat", "DCFAPRT1", 8, create,
+                              &a->plen, &a->pfp)))
+        return -1;
+
+    a->pmax = a->plen;
+
+    for(off = 0; off + 8 <= a->plen; off += part_reclen(a->parts + off)) {
+        nl = part_reclen(a->parts + off);
+
+        if(off + nl > a->plen)
+            break;
+
+        for(i = 0; i < (int)get32(a->parts + off + 4); ++i) {
+            len = get32(a->parts + off + 8 + i * 4);
+
+            if(len != ARC_ERASED && len >= a->nblocks)
+                break;
+        }
+
+        if(i < (int)get32(a->parts + off + 4))
+            break;
+
+        ++a->nparts;
+    }
+
+    if(off != a->plen) {
+        a->plen = off;
+
+        if(trim_file(dir, "parts.dat", a->pfp, 8 + off))
+            return -1;
+    }
+
+    if(part_table(a, table_size(a->nparts)))
+        return -1;
+
+    /* Images. */
+    if(!(imgs = load_file(dir, "images.dat", "DCFAIMG1", 8, create, &len,
+                          &a->ifp)))
+        return -1;
+
+    for(off = 0; off + 28 <= len; off += 28 + nl) {
+        nl = imgs[off] | (imgs[off + 1] << 8);
+
+        if(off + 28 + nl > len)
+            break;
+
+        for(i = 0; i < NUM_PARTS; ++i) {
+            if(get32(imgs + off + 8 + i * 4) >= a->plen)
+                break;
+        }
+
+        if(i < NUM_PARTS)
+            break;
+
+        /* Running out of memory doesn't mean the rest of the file is bad, so
+           don't let it be trimmed off. */
+        if(grow((void **)&a->images, &a->maximages, a->nimages + 1,
+                sizeof(image_rec_t)))
+            goto oom;
+
+        if(!(name = (char *)malloc(nl + 1))) {
+            printf("Out of memory\n");
+            goto oom;
+        }
+
+        memcpy(name, imgs + off + 28, nl);
+        name[nl] = 0;
+
+        r = &a->images[a->nimages++];
+        r->name = name;
+        r->crc = get32(imgs + off + 4);
+
+        for(i = 0; i < NUM_PARTS; ++i) {
+            r->parts[i] = get32(imgs + off + 8 + i * 4);
+        }
+    }
+
+    free(imgs);
+
+    if(off != len && trim_file(dir, "images.dat", a->ifp, 8 + off))
+        return -1;
+
+    fseek(a->bfp, 0, SEEK_END);
+    fseek(a->pfp, 0, SEEK_END);
+    fseek(a->ifp, 0, SEEK_END);
+    return 0;
+
+oom:
+    free(imgs);
+    return -1;
+}
+
+static int arc_close(arc_t *a) {
+    int rv = 0, i;
+
+    /* Everything an image refers to has to be out before the image is. */
+    if(fclose(a->bfp))
+        rv = -1;
+
+    if(fclose(a->pfp))
+        rv = -1;
+
+    if(fclose(a->ifp))
+        rv = -1;
+
+    if(rv)
+        printf("Error writing archive\n");
+
+    for(i = 0; i < a->nimages; ++i) {
+        free(a->images[i].name);
+    }
+
+    free(a->images);
+    free(a->blocks);
+    free(a->btab);
+    free(a->parts);
+    free(a->ptab);
+    return rv;
+}
+
+static int find_image(arc_t *a, const char *name) {
+    int i;
+
+    for(i = a->nimages - 1; i >= 0; --i) {
+        if(!strcmp(a->images[i].name, name))
+            return i;
+    }
+
+    return -1;
+}
+
+/* Everything about an image that can be worked out without looking at the
+   archive, so that it can be done on lots of images at once. */
+typedef struct ingest {
+    const char *name;
+    int ok;
+    uint8_t img[FLASHROM_SIZE];
+    uint64_t h[IMG_BLOCKS];
+    int used[NUM_PARTS];            /* Allocated slots if packed, or -1 */
+} ingest_t;
+
+typedef struct batch {
+    ingest_t *items;
+    pthread_mutex_t load_lock;
+} batch_t;
+
+static int load_image(batch_t *b, const char *fn, uint8_t *img) {
+    uint8_t hdr[8];
+    FILE *fp;
+    int rv;
+
+    if(!(fp = fopen(fn, "rb")))
+        return -1;
+
+    rv = (int)fread(hdr, 1, 8, fp);
+
+    /* Reading sparse dumps isn't reentrant, so only do one of those at a
+       time. Raw dumps can come in all at once. */
+    if(dump_is_sparse(hdr, rv)) {
+        fclose(fp);
+        pthread_mutex_lock(&b->load_lock);
+        rv = dump_load(fn, img);
+        pthread_mutex_unlock(&b->load_lock);
+        return rv < 0 ? -1 : 0;
+    }
+
+    memcpy(img, hdr, rv);
+    rv += (int)fread(img + rv, 1, FLASHROM_SIZE - rv, fp);
+
+    if(rv != FLASHROM_SIZE || fgetc(fp) != EOF)
+        rv = -1;
+
+    fclose(fp);
+    return rv < 0 ? -1 : 0;
+}
+
+static void ingest_one(int i, int thd, void *d) {
+    batch_t *b = (batch_t *)d;
+    ingest_t *it = &b->items[i];
+    part_index_t *idx;
+    const uint8_t *buf;
+    int p, offset, len, j, end;
+
+    (void)thd;
+    it->ok = 0;
+
+    if(load_image(b, it->name, it->img)) {
+        fprintf(stderr, "Cannot read %s as a flashrom dump\n", it->name);
+        return;
+    }
+
+    for(j = 0; j < IMG_BLOCKS; ++j) {
+        it->h[j] = hash(it->img + (j << 6), 64);
+    }
+
+    if(!(idx = (part_index_t *)malloc(sizeof(part_index_t))))
+        return;
+
+    for(p = 0; p < NUM_PARTS; ++p) {
+        flash_image_ops.info(p, &offset, &len);
+        buf = it->img + offset;
+        it->used[p] = -1;
+
+        if(part_index_build(idx, buf, len))
+            continue;
+
+        end = len - idx->bmlen;
+
+        for(j = PART_SLOT_OFFSET(idx->used); j < end; j += 64) {
+            if(memcmp(buf + j, erased, 64))
+                break;
+        }
+
+        if(j >= end)
+            it->used[p] = idx->used;
+    }
+
+    free(idx);
+    it->ok = 1;
+}
+
+/* Build the partition record for one partition of an image, adding any new
+   blocks along the way. */
+static int64_t store_part(arc_t *a, ingest_t *it, int p, uint8_t *rec) {
+    int offset, len, n = 0, i, blk;
+    int64_t r;
+
+    flash_image_ops.info(p, &offset, &len);
+    rec[0] = (uint8_t)p;
+    rec[1] = it->used[p] >= 0;
+    rec[2] = rec[3] = 0;
+
+    for(i = 0; i < (len >> 6); ++i) {
+        /* Packed partitions skip the blank space before the bitmap. */
+        if(it->used[p] >= 0 && i > it->used[p] &&
+           i < (len >> 6) - (int)(((((len >> 6) + 511) & ~511) >> 3) >> 6))
+            continue;
+
+        blk = (offset >> 6) + i;
+
+        if((r = add_block(a, it->img + (blk << 6), it->h[blk])) < 0)
+            return -1;
+
+        put32(rec + 8 + n * 4, (uint32_t)r);
+        ++n;
+    }
+
+    put32(rec + 4, n);
+    return add_part(a, rec);
+}
+
+static int store_image(arc_t *a, ingest_t *it) {
+    static uint8_t rec[8 + IMG_BLOCKS * 4];
+    uint8_t hdr[28];
+    image_rec_t *r;
+    int64_t pr;
+    int p, nl = (int)strlen(it->name);
+
+    if(nl > 65535 || grow((void **)&a->images, &a->maximages,
+                          a->nimages + 1, sizeof(image_rec_t)))
+        return -1;
+
+    r = &a->images[a->nimages];
+    r->crc = crc32(0, it->img, FLASHROM_SIZE);
+    hdr[0] = (uint8_t)nl;
+    hdr[1] = (uint8_t)(nl >> 8);
+    hdr[2] = hdr[3] = 0;
+    put32(hdr + 4, r->crc);
+
+    for(p = 0; p < NUM_PARTS; ++p) {
+        if((pr = store_part(a, it, p, rec)) < 0)
+            return -1;
+
+        r->parts[p] = (uint32_t)pr;
+        put32(hdr + 8 + p * 4, r->parts[p]);
+    }
+
+    if(!(r->name = strdup(it->name)))
+        return -1;
+
+    /* Blocks and partitions go out before the image that uses them, so that a
+       crash part way through never leaves an image pointing at nothing. */
+    if(fflush(a->bfp) || fflush(a->pfp) || fwrite(hdr, 1, 28, a->ifp) != 28 ||
+       fwrite(it->name, 1, nl, a->ifp) != (size_t)nl || fflush(a->ifp)) {
+        free(r->name);
+        return -1;
+    }
+
+    ++a->nimages;
+    return 0;
+}
+
+static int cmd_add(arc_t *a, filelist_t *fl, int nthreads) {
+    batch_t b;
+    int i, j, n, added = 0, skipped = 0, failed = 0, rv = 0;
+    uint32_t nb = a->nblocks, np = a->nparts;
+
+    if(!(b.items = (ingest_t *)malloc(sizeof(ingest_t) * BATCH))) {
+        printf("Out of memory\n");
+        return -1;
+    }
+
+    pthread_mutex_init(&b.load_lock, NULL);
+
+    for(i = 0; i < fl->count && !rv; i += BATCH) {
+        n = fl->count - i < BATCH ? fl->count - i : BATCH;
+
+        for(j = 0; j < n; ++j) {
+            b.items[j].name = fl->files[i + j];
+        }
+
+        /* Hashing and parsing happens all at once, but images get added in the
+           order they were given, so that the archive always comes out the
+           same for the same input. */
+        if(pool_run(nthreads < n ? nthreads : n, n, ingest_one, &b)) {
+            rv = -1;
+            break;
+        }
+
+        for(j = 0; j < n; ++j) {
+            if(!b.items[j].ok) {
+                ++failed;
+            }
+            else if(find_image(a, b.items[j].name) >= 0) {
+                ++skipped;
+            }
+            else if(store_image(a, &b.items[j])) {
+                printf("Error adding %s\n", b.items[j].name);
+                rv = -1;
+                break;
+            }
+            else {
+                ++added;
+            }
+        }
+    }
+
+    pthread_mutex_destroy(&b.load_lock);
+    free(b.items);
+
+    printf("Added %d image(s) (%d already there, %d unreadable), %u new "
+           "blocks, %u new partitions\n", added, skipped, failed,
+           a->nblocks - nb, a->nparts - np);
+    return rv || failed ? -1 : 0;
+}
+
+/* Put an image back together from the archive. */
+static int build_image(arc_t *a, int i, uint8_t *img) {
+    const image_rec_t *r = &a->images[i];
+    const uint8_t *rec;
+    uint32_t ref, n;
+    int p, offset, len, j, k, bmstart;
+
+    memset(img, 0xFF, FLASHROM_SIZE);
+
+    for(p = 0; p < NUM_PARTS; ++p) {
+        flash_image_ops.info(p, &offset, &len);
+        rec = a->parts + r->parts[p];
+        n = get32(rec + 4);
+        bmstart = (len >> 6) - (((((len >> 6) + 511) & ~511) >> 3) >> 6);
+
+        if(rec[0] != p || n > (uint32_t)(len >> 6) ||
+           (!rec[1] && n != (uint32_t)(len >> 6))) {
+            printf("Archive is corrupt (partition %d of %s)\n", p, r->name);
+            return -1;
+        }
+
+        for(j = 0; j < (int)n; ++j) {
+            /* In a packed partition, the bitmap comes after the slots. */
+            k = j;
+
+            if(rec[1] && j >= (int)n - ((len >> 6) - bmstart))
+                k = bmstart + j - ((int)n - ((len >> 6) - bmstart));
+
+            ref = get32(rec + 8 + j * 4);
+
+            if(ref != ARC_ERASED)
+                memcpy(img + offset + (k << 6), a->blocks + (size_t)ref * 64,
+                       64);
+        }
+    }
+
+    if(crc32(0, img, FLASHROM_SIZE) != r->crc) {
+        printf("CRC mismatch rebuilding %s\n", r->name);
+        return -1;
+    }
+
+    return 0;
+}
+
+static const uint8_t *out_img;
+
+static int out_read(int offset, void *buf, int len) {
+    memcpy(buf, out_img + offset, len);
+    return 0;
+}
+
+static int cmd_extract(arc_t *a, const char *name, const char *out,
+                       int sparse) {
+    static uint8_t img[FLASHROM_SIZE];
+    FILE *fp;
+    int i, ok;
+    char *end;
+
+    /* Images can be picked by name, or by number with a #. */
+    if(name[0] == '#') {
+        i = (int)strtol(name + 1, &end, 10);
+
+        if(*end || i < 0 || i >= a->nimages)
+            i = -1;
+    }
+    else {
+        i = find_image(a, name);
+    }
+
+    if(i < 0) {
+        printf("No image %s in the archive\n", name);
+        return -1;
+    }
+
+    if(build_image(a, i, img))
+        return -1;
+
+    if(!(fp = fopen(out, "wb"))) {
+        printf("Cannot open %s for writing\n", out);
+        return -1;
+    }
+
+    out_img = img;
+
+    if(sparse)
+        ok = dump_write(fp, out_read, NULL, NULL) >= 0;
+    else
+        ok = fwrite(img, 1, FLASHROM_SIZE, fp) == FLASHROM_SIZE;
+
+    if(fclose(fp) || !ok) {
+        printf("Error writing %s\n", out);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int cmd_list(arc_t *a) {
+    int i;
+
+    for(i = 0; i < a->nimages; ++i) {
+        printf("%5d %08" PRIX32 " %s\n", i, a->images[i].crc,
+               a->images[i].name);
+    }
+
+    return 0;
+}
+
+static int cmd_stats(arc_t *a) {
+    uint64_t raw = (uint64_t)a->nimages * FLASHROM_SIZE;
+    uint64_t stored = 64 + (uint64_t)a->nblocks * 64 + 8 + a->plen + 8;
+    int i;
+
+    for(i = 0; i < a->nimages; ++i) {
+        stored += 28 + strlen(a->images[i].name);
+    }
+
+    printf("Images: %d\n"
+           "Unique blocks: %u\n"
+           "Unique partitions: %u\n"
+           "Raw size: %" PRIu64 " bytes\n"
+           "Archive size: %" PRIu64 " bytes (%.1f%%)\n", a->nimages,
+           a->nblocks, a->nparts, raw, stored,
+           raw ? stored * 100.0 / raw : 0.0);
+    return 0;
+}
+
+static void usage(const char *argv0) {
+    printf("Usage: %s [-j threads] [-l list] [-s] archive command [args]\n\n"
+           "Commands:\n"
+           "  add [path...]   Add flashrom dumps (raw or sparse) to the\n"
+           "                  archive, searching directories recursively\n"
+           "  list            List the images in the archive\n"
+           "  extract image output\n"
+           "                  Write out an image, given by name or by #number\n"
+           "  stats           Show how much space deduplication is saving\n\n"
+           "An archive is a directory, which is created if need be. With -l,\n"
+           "paths to add are also read one per line from the given file (or\n"
+           "- for stdin). Images are extracted as raw dumps, or as sparse ones\n"
+           "with -s.\n", argv0);
+}
+
+int main(int argc, char *argv[]) {
+    filelist_t fl;
+    arc_t a;
+    const char *cmd;
+    int c, i, rv, sparse = 0, nthreads = pool_default_threads();
+
+    memset(&fl, 0, sizeof(fl));
+
+    while((c = getopt(argc, argv, "j:l:sh")) != -1) {
+        switch(c) {
+            case 'j':
+                nthreads = atoi(optarg);
+                break;
+
+            case 'l':
+                if(filelist_add_list(&fl, optarg))
+                    return 1;
+                break;
+
+            case 's':
+                sparse = 1;
+                break;
+
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if(argc - optind < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    cmd = argv[optind + 1];
+
+    if(nthreads < 1)
+        nthreads = 1;
+
+    if(!strcmp(cmd, "add")) {
+        for(i = optind + 2; i < argc; ++i) {
+            if(filelist_add_path(&fl, argv[i]))
+                return 1;
+        }
+
+        if(!fl.count) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    else if(strcmp(cmd, "list") && strcmp(cmd, "stats") &&
+            (strcmp(cmd, "extract") || argc - optind < 4)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(arc_open(&a, argv[optind], !strcmp(cmd, "add")))
+        return 1;
+
+    if(!strcmp(cmd, "add"))
+        rv = cmd_add(&a, &fl, nthreads);
+    else if(!strcmp(cmd, "list"))
+        rv = cmd_list(&a);
+    else if(!strcmp(cmd, "stats"))
+        rv = cmd_stats(&a);
+    else
+        rv = cmd_extract(&a, argv[optind + 2], argv[optind + 3], sparse);
+
+    filelist_free(&fl);
+
+    if(arc_close(&a))
+        rv = -1;
+
+    return rv ? 1 : 0;
+}
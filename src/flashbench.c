@@ -0,0 +1,592 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <dc/biosfont.h>
+
+#include "fb_console.h"
+#include "flashrom.h"
+#include "partidx.h"
+#include "benchref.h"
+#include "utils.h"
+
+/* Host benchmarks for the flashrom engine and the console's text output. Each
+   run builds a synthetic flashrom image for every combination of fill level
+   and block number distribution asked for, then times the current code and the
+   original versions from benchref.c against it. Results go to stdout as CSV
+   or JSON lines; everything the engine itself prints is thrown away.
+
+   With -S, the scrub strategies are run on the NOR flash simulator instead,
+   reporting what each one does to the flash rather than how fast the code
+   is. */
+
+#define DIST_UNIQUE     0
+#define DIST_UNIFORM    1
+#define DIST_HOT        2
+
+static const char *dist_names[] = { "unique", "uniform", "hot" };
+
+#define OUT_CSV     0
+#define OUT_JSON    1
+
+static FILE *out;
+static int format = OUT_CSV;
+static const char *filter = "*";
+static uint64_t min_ns = 100000000;
+static uint32_t rng_state;
+
+static uint8_t image[FLASHROM_SIZE];
+static uint8_t after[FLASHROM_SIZE];
+
+/* xorshift32, which is plenty for making up block contents. */
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Fill in a block partition with a valid header, fill percent of its block
+   slots allocated, and a bitmap to match. Block numbers are either all
+   different, spread evenly over a small range, or mostly one block that keeps
+   getting rewritten (like the system settings). Block 1 also gets a set of PSO
+   serial numbers somewhere in it. */
+static void make_part(int p, int fill, int dist) {
+    uint8_t *buf, *blk, *bitmap;
+    int offset, len, bmlen, nblks, used, keys, i, j;
+    uint16_t id, crc;
+
+    flash_image_ops.info(p, &offset, &len);
+    buf = image + offset;
+    memset(buf, 0xFF, len);
+    memcpy(buf, "KATANA_FLASH____", 16);
+    buf[16] = (uint8_t)p;
+    buf[17] = 0;
+
+    bmlen = PART_BITMAP_LEN(len);
+    nblks = PART_BLOCKS(len);
+    bitmap = buf + len - bmlen;
+    used = nblks * fill / 100;
+    keys = (p == FLASHROM_PT_BLOCK_1 && used) ? (int)(rng() % used) : -1;
+
+    for(i = 0; i < used; ++i) {
+        blk = buf + ((i + 1) << 6);
+
+        if(i == keys)
+            id = FLASHROM_B1_PSOKEYS;
+        else if(dist == DIST_UNIQUE)
+            id = (uint16_t)(i * 40503 + 0x100);
+        else if(dist == DIST_UNIFORM)
+            id = (uint16_t)(1 + rng() % 64);
+        else
+            id = (rng() & 3) ? 5 : (uint16_t)(1 + rng() % 256);
+
+        if(id == FLASHROM_B1_PSOKEYS && i != keys)
+            ++id;
+
+        blk[0] = (uint8_t)id;
+        blk[1] = (uint8_t)(id >> 8);
+
+        for(j = 2; j < FLASHROM_OFFSET_CRC; ++j) {
+            blk[j] = (uint8_t)rng();
+        }
+
+        if(i == keys) {
+            blk[4] = '1';
+            blk[5] = 'S';
+        }
+
+        crc = flash_block_crc(blk);
+        blk[FLASHROM_OFFSET_CRC] = (uint8_t)crc;
+        blk[FLASHROM_OFFSET_CRC + 1] = (uint8_t)(crc >> 8);
+        bitmap[i >> 3] &= ~(0x80 >> (i & 7));
+    }
+}
+
+static void make_image(int fill, int dist) {
+    memset(image, 0xFF, FLASHROM_SIZE);
+    make_part(FLASHROM_PT_BLOCK_1, fill, dist);
+    make_part(FLASHROM_PT_SETTINGS, fill, dist);
+    make_part(FLASHROM_PT_BLOCK_2, fill, dist);
+
+    /* Swapping the backend throws out anything cached from the last image. */
+    flash_image_set(image);
+    flash_set_ops(&flash_image_ops);
+}
+
+typedef void (*bench_fn_t)(void *arg);
+
+/* Run fn enough times to take at least min_ns, doubling the count each time
+   it comes up short, and report how long each call took. */
+static void run(const char *name, const char *impl, int fill, int dist,
+                bench_fn_t fn, void *arg, int bytes) {
+    uint64_t t, iters = 0, n = 1, i;
+    double ns, bps;
+    char tag[64];
+
+    snprintf(tag, sizeof(tag), "%s/%s", name, impl);
+    if(!glob_match(filter, tag))
+        return;
+
+    for(;;) {
+        t = now_ns();
+
+        for(i = 0; i < n; ++i) {
+            fn(arg);
+        }
+
+        t = now_ns() - t;
+        iters = n;
+
+        if(t >= min_ns || n >= (1ULL << 40))
+            break;
+
+        n <<= 1;
+    }
+
+    ns = (double)t / iters;
+    bps = bytes ? bytes * 1e9 / ns : 0.0;
+
+    if(format == OUT_CSV)
+        fprintf(out, "%s,%s,%d,%s,%d,%llu,%.1f,%.0f\n", name, impl, fill,
+                dist >= 0 ? dist_names[dist] : "", bytes,
+                (unsigned long long)iters, ns, bps);
+    else
+        fprintf(out, "{\"bench\":\"%s\",\"impl\":\"%s\",\"fill\":%d,"
+                "\"dist\":\"%s\",\"bytes\":%d,\"iters\":%llu,"
+                "\"ns_per_op\":%.1f,\"bytes_per_s\":%.0f}\n", name, impl, fill,
+                dist >= 0 ? dist_names[dist] : "", bytes,
+                (unsigned long long)iters, ns, bps);
+
+    fflush(out);
+}
+
+/* State for the partition benchmarks. The partition gets copied back into
+   work before each call to remove_blocks, since it's done in place. */
+typedef struct part_arg {
+    const uint8_t *src;
+    uint8_t *work;
+    int len;
+    FILE *null;
+} part_arg_t;
+
+static void b_remove(void *d) {
+    part_arg_t *a = (part_arg_t *)d;
+    int nr;
+
+    memcpy(a->work, a->src, a->len);
+    remove_block(FLASHROM_B1_PSOKEYS, a->work, a->len, &nr);
+}
+
+static void b_remove_ref(void *d) {
+    part_arg_t *a = (part_arg_t *)d;
+    uint16_t bn[] = { FLASHROM_B1_PSOKEYS };
+    int nr;
+
+    memcpy(a->work, a->src, a->len);
+    ref_remove_blocks(bn, 1, a->work, a->len, &nr);
+}
+
+static void b_read(void *d) {
+    uint8_t *buf;
+    int len;
+
+    (void)d;
+    read_partition(FLASHROM_PT_BLOCK_1, &buf, &len);
+}
+
+static void b_read_ref(void *d) {
+    uint8_t *buf;
+    int len;
+
+    (void)d;
+    if(ref_read_partition(FLASHROM_PT_BLOCK_1, &buf, &len) >= 0)
+        free(buf);
+}
+
+static void b_keys(void *d) {
+    uint32_t v1, v2;
+
+    (void)d;
+    find_pso_keys(&v1, &v2);
+}
+
+static void b_keys_ref(void *d) {
+    uint32_t v1, v2;
+
+    (void)d;
+    ref_find_pso_keys(&v1, &v2);
+}
+
+static void b_hex(void *d) {
+    part_arg_t *a = (part_arg_t *)d;
+    fprint_buf(a->null, a->src, a->len);
+}
+
+static void b_hex_ref(void *d) {
+    part_arg_t *a = (part_arg_t *)d;
+    ref_fprint_buf(a->null, a->src, a->len);
+}
+
+static void bench_image(int fill, int dist, FILE *null) {
+    part_arg_t a;
+    int offset;
+
+    make_image(fill, dist);
+    flash_image_ops.info(FLASHROM_PT_BLOCK_1, &offset, &a.len);
+    a.src = image + offset;
+    a.null = null;
+
+    if(!(a.work = (uint8_t *)malloc(a.len)))
+        return;
+
+    run("remove_blocks", "current", fill, dist, b_remove, &a, a.len);
+    run("remove_blocks", "original", fill, dist, b_remove_ref, &a, a.len);
+    run("read_partition", "current", fill, dist, b_read, NULL, a.len);
+    run("read_partition", "original", fill, dist, b_read_ref, NULL, a.len);
+    run("find_pso_keys", "current", fill, dist, b_keys, NULL, 0);
+    run("find_pso_keys", "original", fill, dist, b_keys_ref, NULL, 0);
+    run("fprint_buf", "current", fill, dist, b_hex, &a, a.len);
+    run("fprint_buf", "original", fill, dist, b_hex_ref, &a, a.len);
+
+    free(a.work);
+}
+
+/* A line that's a bit shorter than the screen is wide, so every call scrolls
+   the console by a line. */
+static const char fb_line[] = "0123 45 67 89 AB CD EF 01 23 45 67  ...Eg#.\n";
+
+static void b_fb_lines(void *d) {
+    (void)d;
+    fb_write_string(fb_line);
+}
+
+static void b_fb_clear(void *d) {
+    (void)d;
+    fb_clear(0x0010);
+}
+
+static void bench_fb(void) {
+    fb_clear(0x0010);
+    run("fb_write_string", "current", 0, -1, b_fb_lines, NULL,
+        (int)sizeof(fb_line) - 1);
+    run("fb_clear", "current", 0, -1, b_fb_clear, NULL, 640 * 480 * 2);
+}
+
+/* The ways of getting rid of the PSO serial numbers, to compare on the
+   simulator. */
+static int s_erase(void) {
+    return erase_flashrom();
+}
+
+static int s_remove(void) {
+    return erase_pso_keys();
+}
+
+static int s_kill(void) {
+    return flash_kill_block(FLASHROM_PT_BLOCK_1, FLASHROM_B1_PSOKEYS);
+}
+
+static const struct {
+    const char *name;
+    int (*fn)(void);
+} strategies[] = {
+    { "erase_flashrom", s_erase },
+    { "erase_pso_keys", s_remove },
+    { "kill_block", s_kill }
+};
+
+#define NUM_STRATEGIES  (int)(sizeof(strategies) / sizeof(strategies[0]))
+
+static const uint8_t *latest(const part_index_t *idx, const uint8_t *buf,
+                             uint16_t id) {
+    const part_entry_t *e = part_index_find(idx, id);
+    return e && e->slot >= 0 ? buf + PART_SLOT_OFFSET(e->slot) : NULL;
+}
+
+static int same_block(const uint8_t *a, const uint8_t *b) {
+    return a ? b && !memcmp(a, b, 64) : !b;
+}
+
+/* A power cut leaves the flashrom torn if the latest good copy of any block is
+   neither what it was before the operation started, nor what it ends up as
+   when the operation isn't cut short. */
+static int torn(const uint8_t *cut) {
+    static part_index_t ib, ia, ic;
+    const part_index_t *src[2] = { &ib, &ia };
+    const uint8_t *b, *a, *c;
+    int p, offset, len, i, j;
+    uint16_t id;
+
+    for(p = FLASHROM_PT_BLOCK_1; p <= FLASHROM_PT_BLOCK_2; ++p) {
+        flash_sim_ops.info(p, &offset, &len);
+
+        if(part_index_build(&ib, image + offset, len))
+            ib.count = 0;
+        if(part_index_build(&ia, after + offset, len))
+            ia.count = 0;
+        if(part_index_build(&ic, cut + offset, len))
+            ic.count = 0;
+
+        for(i = 0; i < 2; ++i) {
+            for(j = 0; j < src[i]->count; ++j) {
+                id = src[i]->ent[j].id;
+                b = latest(&ib, image + offset, id);
+                a = latest(&ia, after + offset, id);
+                c = latest(&ic, cut + offset, id);
+
+                if(!same_block(c, b) && !same_block(c, a))
+                    return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* Run each strategy on the simulator, starting from the current image. Then
+   run it again once for every program and erase it did, losing power during
+   that one, and count how many of those leave the flashrom torn. */
+static void bench_sim(int fill, int dist) {
+    flash_sim_stats_t st;
+    uint32_t ops, k, ntorn, erases, programmed;
+    uint64_t t;
+    int i, p, offset, len, erased, n;
+    char parts[128];
+
+    make_image(fill, dist);
+
+    for(i = 0; i < NUM_STRATEGIES; ++i) {
+        if(!glob_match(filter, strategies[i].name))
+            continue;
+
+        flash_sim_set(image);
+        flash_set_ops(&flash_sim_ops);
+        flash_sim_reset_stats();
+
+        t = now_ns();
+        strategies[i].fn();
+        t = now_ns() - t;
+
+        flash_sim_get_stats(&st);
+        memcpy(after, flash_sim_image(), FLASHROM_SIZE);
+
+        /* Bytes programmed in each partition, in partition number order. */
+        for(p = 0, n = 0, erases = 0, erased = 0, programmed = 0;
+            p <= FLASHROM_PT_BLOCK_2; ++p) {
+            flash_sim_ops.info(p, &offset, &len);
+            erases += st.erases[p];
+            erased += st.erases[p] * len;
+            programmed += st.programmed[p];
+            n += sprintf(parts + n, "%s%" PRIu32, p ? (format == OUT_CSV ?
+                         ":" : ",") : "", st.programmed[p]);
+        }
+
+        ops = st.programs + erases;
+
+        for(k = 1, ntorn = 0; k <= ops; ++k) {
+            flash_sim_set(image);
+            flash_set_ops(&flash_sim_ops);
+            flash_sim_power_cut(k);
+            strategies[i].fn();
+            flash_sim_power_on();
+            ntorn += torn(flash_sim_image());
+        }
+
+        if(format == OUT_CSV)
+            fprintf(out, "%s,%d,%s,%" PRIu32 ",%" PRIu32 ",%s,%" PRIu32 ",%d,"
+                    "%.1f,%.1f,%" PRIu32 ",%" PRIu32 "\n", strategies[i].name,
+                    fill, dist_names[dist], st.programs, programmed, parts,
+                    erases, erased, st.busy_ns / 1000.0, t / 1000.0, ops,
+                    ntorn);
+        else
+            fprintf(out, "{\"strategy\":\"%s\",\"fill\":%d,\"dist\":\"%s\","
+                    "\"programs\":%" PRIu32 ",\"programmed\":%" PRIu32 ","
+                    "\"programmed_parts\":[%s],\"erases\":%" PRIu32 ","
+                    "\"erased\":%d,\"busy_us\":%.1f,\"cpu_us\":%.1f,"
+                    "\"cut_points\":%" PRIu32 ",\"torn\":%" PRIu32 "}\n",
+                    strategies[i].name, fill, dist_names[dist], st.programs,
+                    programmed, parts, erases, erased, st.busy_ns / 1000.0,
+                    t / 1000.0, ops, ntorn);
+
+        fflush(out);
+    }
+}
+
+static int parse_list(const char *s, int *vals, int max, int dist) {
+    char tmp[256], *tok, *save;
+    int n = 0, i;
+
+    snprintf(tmp, sizeof(tmp), "%s", s);
+
+    for(tok = strtok_r(tmp, ",", &save); tok && n < max;
+        tok = strtok_r(NULL, ",", &save)) {
+        if(!dist) {
+            vals[n] = atoi(tok);
+
+            if(vals[n] < 0 || vals[n] > 100)
+                return -1;
+
+            ++n;
+            continue;
+        }
+
+        for(i = 0; i < 3 && strcmp(tok, dist_names[i]); ++i) ;
+
+        if(i == 3)
+            return -1;
+
+        vals[n++] = i;
+    }
+
+    return n;
+}
+
+static void usage(const char *argv0) {
+    printf("Usage: %s [-f csv|json] [-F fills] [-d dists] [-t ms] [-s seed]\n"
+           "          [-b pattern] [-S] [-T program_ns,erase_us]\n\n"
+           "Times the flashrom engine and console output on synthetic flashrom\n"
+           "images, against the original implementations.\n\n"
+           "  -F fills    Comma separated partition fill levels, in percent\n"
+           "              (default 25,50,100)\n"
+           "  -d dists    Comma separated block number distributions: unique,\n"
+           "              uniform, hot (default all of them)\n"
+           "  -t ms       Minimum time to spend on each benchmark (default 100)\n"
+           "  -s seed     Seed for the image generator (default 1)\n"
+           "  -b pattern  Only run benchmarks whose bench/impl name matches\n"
+           "              the given pattern (like remove_blocks/*)\n"
+           "  -S          Run the scrub strategies on the NOR flash simulator\n"
+           "              and report their flash usage and how many power\n"
+           "              loss points leave the flashrom torn (-b matches the\n"
+           "              strategy name)\n"
+           "  -T ns,us    Simulated program time per byte and erase time per\n"
+           "              sector (default 9000,700000)\n", argv0);
+}
+
+int main(int argc, char *argv[]) {
+    int fills[16] = { 25, 50, 100 }, dists[3] = { 0, 1, 2 };
+    int nfills = 3, ndists = 3, sim = 0, c, i, j;
+    flash_sim_timing_t tm = { 0, 9000, 700000, 0 };
+    uint32_t seed = 1;
+    FILE *null;
+
+    while((c = getopt(argc, argv, "f:F:d:t:s:b:ST:h")) != -1) {
+        switch(c) {
+            case 'f':
+                if(!strcmp(optarg, "csv"))
+                    format = OUT_CSV;
+                else if(!strcmp(optarg, "json"))
+                    format = OUT_JSON;
+                else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+
+            case 'F':
+                if((nfills = parse_list(optarg, fills, 16, 0)) <= 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+
+            case 'd':
+                if((ndists = parse_list(optarg, dists, 3, 1)) <= 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+
+            case 't':
+                min_ns = strtoull(optarg, NULL, 0) * 1000000;
+                break;
+
+            case 's':
+                seed = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+
+            case 'b':
+                filter = optarg;
+                break;
+
+            case 'S':
+                sim = 1;
+                break;
+
+            case 'T':
+                if(sscanf(optarg, "%" SCNu32 ",%" SCNu32, &tm.program_ns,
+                          &tm.erase_us) != 2) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 1;
+        }
+    }
+
+    /* Results go out on the real stdout, and all of the chatter from the
+       engine goes nowhere. */
+    if(!(out = fdopen(dup(STDOUT_FILENO), "w")) ||
+       !freopen("/dev/null", "w", stdout) || !(null = fopen("/dev/null", "w"))) {
+        fprintf(stderr, "Cannot set up output\n");
+        return 1;
+    }
+
+    flash_sim_set_timing(&tm);
+
+    if(format == OUT_CSV && sim)
+        fprintf(out, "strategy,fill,dist,programs,programmed,programmed_parts,"
+                "erases,erased,busy_us,cpu_us,cut_points,torn\n");
+    else if(format == OUT_CSV)
+        fprintf(out, "bench,impl,fill,dist,bytes,iters,ns_per_op,"
+                "bytes_per_s\n");
+
+    for(i = 0; i < nfills; ++i) {
+        for(j = 0; j < ndists; ++j) {
+            rng_state = seed ? seed : 1;
+
+            if(sim)
+                bench_sim(fills[i], dists[j]);
+            else
+                bench_image(fills[i], dists[j], null);
+        }
+    }
+
+    if(!sim)
+        bench_fb();
+
+    fclose(null);
+    fclose(out);
+    return 0;
+}
@@ -22,35 +22,330 @@
 #include <ctype.h>
 #include <inttypes.h>
 
-#include <dc/flashrom.h>
+#ifdef _arch_dreamcast
+#include <arch/timer.h>
+#else
+#include <time.h>
+#endif
 
 #include "flashrom.h"
+#include "partidx.h"
+#include "crc.h"
+#include "flog.h"
+#include "trace.h"
 
-/* From utils.c */
-extern void fprint_buf(FILE *fp, const unsigned char *pkt, int len);
+/* The backend that all flashrom access goes through. On the console this is
+   the real flashrom, anywhere else the caller has to load up an image. */
+#ifdef _arch_dreamcast
+static const flash_ops_t *ops = &flash_kos_ops;
+#else
+static const flash_ops_t *ops = &flash_image_ops;
+#endif
+
+static flash_observer_t observer;
+static int verify;
+static flash_stats_t stats;
+
+/* Partition geometry for the current backend, filled in the first time any of
+   it is needed. A partition that the backend won't tell us about (or that is
+   too big to be one) is left with a length of zero. */
+static flash_geom_t geom[FLASHROM_PT_BLOCK_2 + 1];
+static int geom_ready;
+
+static void geom_init(void) {
+    flash_geom_t *g;
+    int p;
+
+    for(p = FLASHROM_PT_SYSTEM; p <= FLASHROM_PT_BLOCK_2; ++p) {
+        g = &geom[p];
+
+        if(ops->info(p, &g->offset, &g->len) || g->offset < 0 ||
+           g->len < 128 || g->len > FLASHROM_MAX_PART ||
+           g->offset + g->len > FLASHROM_SIZE) {
+            flog(FL_GEOM_BOGUS, p);
+            memset(g, 0, sizeof(flash_geom_t));
+            continue;
+        }
+
+        g->bmlen = PART_BITMAP_LEN(g->len);
+        g->nblks = PART_BLOCKS(g->len);
+    }
+
+    geom_ready = 1;
+}
+
+const flash_geom_t *flash_geom(int p) {
+    if(p < FLASHROM_PT_SYSTEM || p > FLASHROM_PT_BLOCK_2)
+        return NULL;
+
+    if(!geom_ready)
+        geom_init();
+
+    return geom[p].len ? &geom[p] : NULL;
+}
+
+/* Everything the engine works on the flashrom in, set aside up front so that
+   nothing on a flash path ever goes to the heap. The cache holds each
+   partition at the same offset it has on the flash, and the scratch area is
+   where a partition gets rebuilt before it's written back. Lined up with the
+   SH4's 32 byte cache lines. */
+static struct {
+    uint8_t cache[FLASHROM_SIZE];
+    uint8_t scratch[FLASHROM_MAX_PART];
+    part_index_t idx[FLASHROM_PT_BLOCK_2 + 1];
+} arena __attribute__((aligned(32)));
+
+static uint64_t now_us(void) {
+#ifdef _arch_dreamcast
+    return timer_us_gettime64();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static void count_op(int op, int rv, int len, uint64_t start) {
+    flash_op_stats_t *s = &stats.op[op];
+    uint32_t us = (uint32_t)(now_us() - start);
+
+    ++s->count;
+    s->us += us;
+
+    if(us > s->max_us)
+        s->max_us = us;
+
+    if(rv < 0)
+        ++s->errors;
+    else
+        s->bytes += len;
+}
+
+/* Read back something we just programmed and make sure it all stuck. Nothing
+   we write is more than a block long, but go a block at a time just in case. */
+static int fl_verify(int offset, const void *buf, int len) {
+    const uint8_t *want = (const uint8_t *)buf;
+    uint8_t got[64];
+    int i, n;
+
+    for(i = 0; i < len; i += n) {
+        n = len - i > 64 ? 64 : len - i;
+
+        if(ops->read(offset + i, got, n) < 0 || memcmp(got, want + i, n)) {
+            flog(FL_VERIFY_FAILED, offset + i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Everything in here goes through these for reads, writes and erases, so that
+   anyone watching can keep track of what we're doing to the flash. */
+static int fl_read(int offset, void *buf, int len) {
+    uint64_t t = now_us();
+    int rv = ops->read(offset, buf, len);
+
+    count_op(FLASH_OP_READ, rv, len, t);
+
+    if(rv >= 0 && observer)
+        observer(FLASH_OP_READ, offset, len);
+
+    return rv;
+}
+
+static int fl_write(int offset, const void *buf, int len) {
+    uint64_t t = now_us();
+    int rv = ops->write(offset, buf, len);
+
+    count_op(FLASH_OP_WRITE, rv, len, t);
+
+    if(rv >= 0 && observer)
+        observer(FLASH_OP_WRITE, offset, len);
+
+    if(rv >= 0 && verify && fl_verify(offset, buf, len))
+        return -1;
+
+    return rv;
+}
+
+static int fl_erase(int offset) {
+    TRACE_ZONE("fl_erase");
+    uint64_t t = now_us();
+    int rv = ops->erase(offset), p, l = 0;
+    const flash_geom_t *g;
+
+    /* Erases take out the whole partition, so figure out how big it is. */
+    for(p = FLASHROM_PT_SYSTEM; p <= FLASHROM_PT_BLOCK_2; ++p) {
+        g = flash_geom(p);
+
+        if(g && offset >= g->offset && offset < g->offset + g->len) {
+            l = g->len;
+            break;
+        }
+    }
+
+    count_op(FLASH_OP_ERASE, rv, l, t);
+
+    if(rv >= 0 && observer)
+        observer(FLASH_OP_ERASE, offset, l);
+
+    return rv;
+}
+
+void flash_set_observer(flash_observer_t fn) {
+    observer = fn;
+}
+
+void flash_set_verify(int on) {
+    verify = on;
+}
+
+void flash_get_stats(flash_stats_t *st) {
+    *st = stats;
+}
+
+void flash_reset_stats(void) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+/* Copies of partitions that we've read, along with their parsed block index.
+   Nothing else writes to the flashrom while we're running, so these stay good
+   until we write to it ourselves. Both live in the arena. */
+typedef struct part_cache {
+    uint8_t *buf;
+    part_index_t *idx;              /* NULL if there's nothing to index */
+    int len;
+    int valid;
+} part_cache_t;
+
+static part_cache_t cache[FLASHROM_PT_BLOCK_2 + 1];
+
+static void cache_invalidate(void) {
+    int i;
+
+    for(i = 0; i <= FLASHROM_PT_BLOCK_2; ++i) {
+        cache[i].valid = 0;
+    }
+}
+
+static part_cache_t *cache_get(int p) {
+    TRACE_ZONE("cache_get");
+    const flash_geom_t *g;
+    part_cache_t *c;
+    int rv;
+
+    if(!(g = flash_geom(p)))
+        return NULL;
+
+    c = &cache[p];
+    if(c->valid)
+        return c;
+
+    c->buf = arena.cache + g->offset;
+    c->len = g->len;
+
+    rv = fl_read(g->offset, c->buf, g->len);
+    if(rv < 0) {
+        flog(FL_READ_FAILED, rv);
+        return NULL;
+    }
+
+    /* Not every partition has blocks in it (or is in a sane state), so it's
+       alright if there's nothing to index. */
+    c->idx = &arena.idx[p];
+
+    if(part_index_build(c->idx, c->buf, c->len) || c->buf[16] != (uint8_t)p)
+        c->idx = NULL;
+
+    c->valid = 1;
+    return c;
+}
+
+void flash_set_ops(const flash_ops_t *o) {
+    cache_invalidate();
+    ops = o;
+    geom_ready = 0;
+}
+
+/* Raw read through the current backend, for things that want the flashrom as a
+   whole rather than a partition at a time. */
+int flash_read(int offset, void *buf, int len) {
+    return fl_read(offset, buf, len);
+}
+
+/* Get at the contents of a partition without copying it, if the backend can
+   map the flashrom. Otherwise this falls back to the cached copy (which gets
+   read in the first time it's needed). The pointer is good until the next
+   time anything writes to the flashrom. */
+const uint8_t *flash_map_partition(int p, int *len) {
+    const flash_geom_t *g;
+    const uint8_t *m;
+    part_cache_t *c;
+
+    if(ops->map && (g = flash_geom(p)) && (m = ops->map(g->offset, g->len))) {
+        *len = g->len;
+        return m;
+    }
+
+    if(!(c = cache_get(p)))
+        return NULL;
+
+    *len = c->len;
+    return c->buf;
+}
+
+/* Set up a read-only view of a partition. See flash_map_partition. */
+int flash_part_view(int p, part_view_t *v) {
+    const uint8_t *buf;
+    int len;
+
+    if(!(buf = flash_map_partition(p, &len)))
+        return -1;
+
+    return part_view_init(v, buf, len);
+}
+
+/* Get the block index for a partition, and optionally the cached contents of
+   the partition that it refers to. Returns NULL if the partition can't be read
+   or doesn't have a valid header. */
+const part_index_t *flash_part_index(int p, const uint8_t **buf) {
+    part_cache_t *c = cache_get(p);
+
+    if(!c || !c->idx)
+        return NULL;
+
+    if(buf)
+        *buf = c->buf;
+
+    return c->idx;
+}
 
 int erase_partition(int p) {
-    int rv, offset, len;
+    TRACE_ZONE("erase_partition");
+    const flash_geom_t *g;
     uint8_t hdr_block[64];
+    int rv;
 
     /* Make sure it's a sensible partition to delete. */
     if(p < FLASHROM_PT_BLOCK_1 || p > FLASHROM_PT_BLOCK_2) {
-        printf("Request to delete a bogus partition: %d\n", p);
+        flog(FL_BOGUS_DELETE, p);
         return -1;
     }
 
     /* Figure out where we'll be writing. */
-    rv = flashrom_info(p, &offset, &len);
-    if(rv) {
-        printf("Error finding partition!\n");
+    if(!(g = flash_geom(p))) {
+        flog(FL_NO_PARTITION);
         return -1;
     }
 
-    printf("Partition %d: Offset: %d, length: %d\n", p, offset, len);
+    flog(FL_PARTITION, p, g->offset, g->len);
 
     /* Delete the entire partition... */
-    rv = flashrom_delete(offset);
-    printf("Flashrom delete of partition %d returned %d\n", p, rv);
+    cache_invalidate();
+    rv = fl_erase(g->offset);
+    flog(FL_DELETE_PART, p, rv);
 
     /* Set up a new header block. */
     memset(hdr_block, 0xFF, 64);
@@ -59,178 +354,321 @@ int erase_partition(int p) {
     hdr_block[17] = 0;
 
     /* Write it to the flashrom. */
-    rv = flashrom_write(offset, hdr_block, 64);
-    printf("Write flashrom returned %d\n", rv);
+    rv = fl_write(g->offset, hdr_block, 64);
+    flog(FL_WRITE_HEADER, rv);
+    return 0;
+}
+
+/* Bring the flashrom at offset in line with what's in want, doing as little to
+   the flash as possible. The flash can only clear bits when programming, so if
+   every change is a 1 -> 0 transition we can skip erasing entirely and program
+   just the bytes that differ. Otherwise, the sector gets erased and only the
+   parts that aren't left blank are programmed. The region must cover exactly
+   one erase sector (which is the same as a partition on the Dreamcast). */
+int flash_sync(int offset, const uint8_t *want, int len, flash_plan_t *pl) {
+    TRACE_ZONE("flash_sync");
+    uint8_t cur[64];
+    int i, j, first, last, erase = 0, rv;
+
+    pl->erased = 0;
+    pl->written = 0;
+    pl->skipped = 0;
+    cache_invalidate();
+
+    /* First pass: see if there's anything that needs a bit set. */
+    for(i = 0; i < len && !erase; i += 64) {
+        if(fl_read(offset + i, cur, 64) < 0)
+            return -1;
+
+        for(j = 0; j < 64; ++j) {
+            if((cur[j] & want[i + j]) != want[i + j]) {
+                erase = 1;
+                break;
+            }
+        }
+    }
+
+    if(erase) {
+        rv = fl_erase(offset);
+        flog(FL_DELETE_AT, offset, rv);
+
+        if(rv < 0)
+            return -1;
+
+        pl->erased = 1;
+    }
+
+    /* Second pass: program the span of each block that differs from what is
+       there already. After an erase, that's anything that isn't 0xFF. */
+    for(i = 0; i < len; i += 64) {
+        if(erase)
+            memset(cur, 0xFF, 64);
+        else if(fl_read(offset + i, cur, 64) < 0)
+            return -1;
+
+        for(first = 0; first < 64 && cur[first] == want[i + first]; ++first) ;
+
+        if(first == 64) {
+            pl->skipped += 64;
+            continue;
+        }
+
+        for(last = 63; cur[last] == want[i + last]; --last) ;
+
+        rv = fl_write(offset + i + first, want + i + first, last - first + 1);
+        if(rv < 0) {
+            flog(FL_WRITE_AT_FAILED, offset + i + first, rv);
+            return -1;
+        }
+
+        pl->written += last - first + 1;
+        pl->skipped += 64 - (last - first + 1);
+    }
+
     return 0;
 }
 
 int rewrite_partition(int p, uint8_t *buf, int len, int ilen) {
-    int rv, offset, len2;
-    int bmlen;
-    uint8_t *bitmap;
+    TRACE_ZONE("rewrite_partition");
+    const flash_geom_t *g;
+    flash_plan_t pl;
+    int rv;
 
     /* Make sure it's a sensible partition to delete. */
     if(p < FLASHROM_PT_BLOCK_1 || p > FLASHROM_PT_BLOCK_2) {
-        printf("Request to delete a bogus partition: %d\n", p);
+        flog(FL_BOGUS_DELETE, p);
         return -1;
     }
 
     /* Figure out where we'll be writing. */
-    rv = flashrom_info(p, &offset, &len2);
-    if(rv) {
-        printf("Error finding partition!\n");
+    if(!(g = flash_geom(p))) {
+        flog(FL_NO_PARTITION);
         return -1;
     }
 
-    if(len != len2) {
-        printf("Bogus partition length! Bailing out.\n");
+    if(len != g->len) {
+        flog(FL_BOGUS_LENGTH);
         return -1;
     }
-    else if(ilen > len) {
-        printf("Bogus amount of blocks to rewrite!\n");
+    else if(ilen > len - g->bmlen) {
+        flog(FL_BOGUS_AMOUNT);
         return -1;
     }
 
-    printf("Partition %d: Offset: %d, length: %d\n", p, offset, len);
+    flog(FL_PARTITION, p, g->offset, len);
 
-    /* Delete the entire partition... */
-    rv = flashrom_delete(offset);
-    printf("Flashrom delete of partition %d returned %d\n", p, rv);
+    /* Only the first ilen bytes and the bitmap are meant to end up on the
+       flash, so blank out anything in between before syncing it. */
+    memset(buf + ilen, 0xFF, len - g->bmlen - ilen);
 
-    /* Write the initial blocks that we've got. */
-    rv = flashrom_write(offset, buf, ilen);
-    printf("Write flashrom returned %d\n", rv);
-
-    /* Write the bitmap. See the remove_blocks function for the logic here. */
-    bmlen = ((((len >> 6) + 511) & ~511) >> 3);
-    bitmap = buf + len - bmlen;
+    rv = flash_sync(g->offset, buf, len, &pl);
+    if(rv < 0) {
+        flog(FL_REWRITE_FAILED, p);
+        return -1;
+    }
 
-    printf("Writing bitmap at %d (%d)\n", len - bmlen, offset);
-    rv = flashrom_write(offset + len - bmlen, bitmap, bmlen);
-    printf("Write bitmap returned %d\n", rv);
+    /* A blind rewrite would erase and program the blocks and the bitmap. */
+    flog(pl.erased ? FL_REWRITE_ERASED : FL_REWRITE_SKIPPED, p, pl.written,
+         ilen + g->bmlen - pl.written);
     return 0;
 }
 
-int remove_blocks(uint16_t bn[], int bnc, uint8_t *buf, int len, int *nr) {
-    uint8_t *bitmap, *bitmap2;
-    uint8_t *b2;
-    int nremoved = 0, i, j, k, removed = 0;
+/* One bit for each possible logical block number, used by remove_marked to
+   check if a block is one that is to be removed. Only the bits that are set by
+   a call are cleared on the way out, so this never needs a full wipe. */
+static uint32_t rmset[65536 / 32];
+
+static void mark_blocks(uint16_t first, uint16_t last, int on) {
+    uint32_t id;
+
+    for(id = first; id <= last; ++id) {
+        if(on)
+            rmset[id >> 5] |= 1U << (id & 31);
+        else
+            rmset[id >> 5] &= ~(1U << (id & 31));
+    }
+}
+
+static int marked(uint16_t id) {
+    return (rmset[id >> 5] >> (id & 31)) & 1;
+}
+
+/* Compact a partition in place, dropping every block that's marked in
+   rmset. Returns the number of blocks (counting the header) that are left. */
+static int remove_marked(uint8_t *buf, int len, int *nr) {
+    TRACE_ZONE("remove_marked");
+    uint8_t *bitmap, *blk;
+    int nremoved = 0, bmlen, nblks, used, i, j;
+    uint32_t w;
+    uint16_t id;
 
     /* The bitmap is stored at the end of the partition, and has to take up some
-       number of blocks. Thus, we need to figure out how many blocks/bytes it
-       takes up... The loopy math here is as follows:
-       One bit per block => 512 blocks can be represented per bitmap block
-       Each block is 64 bytes in length, thus we take the total partition
-       length, find the number of blocks, figure out how many bitmap bits that
-       would require (rounded up to an even number of blocks), and divide by
-       8 to get the length in bytes. */
-    bitmap = buf + len - ((((len >> 6) + 511) & ~511) >> 3);
+       number of blocks. See PART_BITMAP_LEN for the math. */
+    bmlen = PART_BITMAP_LEN(len);
+    bitmap = buf + len - bmlen;
+    nblks = PART_BLOCKS(len);
+    *nr = 0;
 
     /* Sanity check. */
     if(memcmp(buf, "KATANA_FLASH____", 16)) {
-        printf("Partition dump looks bad...\n");
+        flog(FL_BAD_DUMP);
         return -1;
     }
 
     /* This shouldn't really happen often, but just in case. */
     if(bitmap[0] == 0xff) {
-        printf("Partition is empty, nothing to do.\n");
+        flog(FL_EMPTY);
         return 0;
     }
 
-    /* Allocate our replacement buffer. */
-    if(!(b2 = malloc(len))) {
-        printf("Can't allocate buffer memory\n");
-        return -1;
+    /* Blocks are allocated in order, so the blocks in use run up to the first
+       set bit in the bitmap. Look for it a word at a time. The first block is
+       in the high bit of each byte, so load the words big endian and count the
+       leading zeroes. The bitmap is a multiple of 64 bytes long, so reading a
+       whole word at the end is always safe. */
+    for(used = 0; used < nblks; used += 32) {
+        w = ((uint32_t)bitmap[used >> 3] << 24) |
+            (bitmap[(used >> 3) + 1] << 16) | (bitmap[(used >> 3) + 2] << 8) |
+            bitmap[(used >> 3) + 3];
+
+        if(w) {
+            used += __builtin_clz(w);
+            break;
+        }
     }
 
-    /* Copy the header and clear the rest of the buffer for now. */
-    memcpy(b2, buf, 64);
-    memset(b2 + 64, 0xff, len - 64);
-    bitmap2 = b2 + len - ((((len >> 6) + 511) & ~511) >> 3);
+    if(used > nblks)
+        used = nblks;
 
-    /* This is not efficient, but it is simple and clear... */
-    for(i = 0, j = 0; i < (len >> 6) - 2; ++i) {
-        /* First, see if we've run out of blocks. */
-        if(bitmap[i >> 3] & (0x80 >> (i & 7)))
-            break;
+    /* Anything that's already corrupt gets carried over as-is (the BIOS will
+       ignore it just the same). Checking costs a CRC of every block, so it's
+       only worth doing to tell whoever's watching when we're verifying. */
+    if(verify && (i = part_validate(buf, len)) > 0)
+        flog(FL_BAD_CRCS, i, used);
 
-        /* No, we have a block here, so let's see if it's one we care about. */
-        removed = 0;
+    /* Compact the partition in place, sliding each block we keep down over
+       any that we've removed before it. */
+    for(i = 0, j = 0; i < used; ++i) {
+        blk = buf + ((i + 1) << 6);
+        id = blk[0] | (blk[1] << 8);
 
-        for(k = 0; k < bnc && !removed; ++k) {
-            if((uint16_t)(buf[(i + 1) << 6]) == bn[k]) {
-                printf("Removing block %d (%d so far): blknum: %d\n", i,
-                       nremoved + 1, bn[k]);
-                ++nremoved;
-                removed = 1;
-                break;
-            }
+        if(marked(id)) {
+            flog(FL_REMOVING, i, nremoved + 1, id);
+            ++nremoved;
+            continue;
         }
 
-        if(!removed) {
-            /* Nope, don't care about it, copy it over blindly. */
-            memcpy(b2 + ((j + 1) << 6), buf + ((i + 1) << 6), 64);
-            bitmap2[j >> 3] &= ~(0x80 >> (j & 7));
-            ++j;
-        }
+        if(i != j)
+            memcpy(buf + ((j + 1) << 6), blk, 64);
+
+        ++j;
     }
 
-    memcpy(buf, b2, len);
-    free(b2);
+    /* Clear out whatever is left after the blocks we kept and rebuild the
+       bitmap to match. */
+    memset(buf + ((j + 1) << 6), 0xff, (nblks - j) << 6);
+    memset(bitmap, 0xff, bmlen);
+    memset(bitmap, 0, j >> 3);
+
+    if(j & 7)
+        bitmap[j >> 3] = 0xff >> (j & 7);
+
     *nr = nremoved;
     return j + 1;
 }
 
+int remove_blocks(uint16_t bn[], int bnc, uint8_t *buf, int len, int *nr) {
+    int i, rv;
+
+    for(i = 0; i < bnc; ++i) {
+        mark_blocks(bn[i], bn[i], 1);
+    }
+
+    rv = remove_marked(buf, len, nr);
+
+    for(i = 0; i < bnc; ++i) {
+        mark_blocks(bn[i], bn[i], 0);
+    }
+
+    return rv;
+}
+
 int remove_block(uint16_t b, uint8_t *buf, int len, int *nr) {
     uint16_t b2[] = { b };
     return remove_blocks(b2, 1, buf, len, nr);
 }
 
+/* Get a copy of a partition that can be changed and then handed to
+   rewrite_partition. The copy is in the arena's scratch area, so it mustn't be
+   freed, and it only lasts until the next call that uses the scratch area (this
+   or anything that compacts a partition). */
 int read_partition(int p, uint8_t **buf, int *len) {
-    int rv, offset, l;
-    uint8_t *b;
+    TRACE_ZONE("read_partition");
+    part_cache_t *c;
 
     *buf = NULL;
     *len = -1;
 
-    rv = flashrom_info(p, &offset, &l);
-    if(rv) {
-        printf("Partition %d: Offset: %d, length: %d, rv: %d\n", p, offset, l, rv);
+    if(!(c = cache_get(p)))
         return -1;
-    }
 
-    if(!(b = malloc(l))) {
-        printf("Couldn't allocate buffer!\n");
-        return -1;
-    }
+    memcpy(arena.scratch, c->buf, c->len);
+    *buf = arena.scratch;
+    *len = c->len;
 
-    rv = flashrom_read(offset, b, l);
-    if(rv < 0) {
-        printf("Read flashrom returns %d\n", rv);
-        free(b);
-        return -1;
-    }
+    return 0;
+}
 
-    *buf = b;
-    *len = l;
+/* What flash_scrub gets rid of in each group. Anything not in here (like the
+   system configuration in block 0x05 of Block 1, which has the language and
+   such in it) is left alone. */
+static const struct {
+    uint32_t group;
+    int part;
+    uint16_t first;
+    uint16_t last;
+} scrub_policy[] = {
+    /* PSO serial numbers */
+    { SCRUB_PSO, FLASHROM_PT_BLOCK_1, FLASHROM_B1_PSOKEYS, FLASHROM_B1_PSOKEYS },
+    /* PlanetWeb dial-up, DNS and email settings */
+    { SCRUB_ISP, FLASHROM_PT_BLOCK_1, 0x0080, 0x008A },
+    /* DreamKey dial-up and DNS settings */
+    { SCRUB_ISP, FLASHROM_PT_BLOCK_1, 0x00C6, 0x00C8 },
+    /* ISP, email and login details shared by the browsers */
+    { SCRUB_ISP, FLASHROM_PT_BLOCK_1, 0x00E0, 0x00E9 },
+    /* Everything games have saved in the settings partition */
+    { SCRUB_GAMES, FLASHROM_PT_SETTINGS, 0x0000, 0xFFFF }
+};
 
-    return rv;
-}
+#define NUM_RULES   (int)(sizeof(scrub_policy) / sizeof(scrub_policy[0]))
 
-int erase_pso_keys(void) {
+/* Remove everything marked in rmset from a partition, if there's anything
+   there to remove. Returns the number of blocks removed. */
+static int scrub_partition(int p) {
+    const part_index_t *idx;
     uint8_t *buf;
-    int len, nblks, rv, nr;
+    int i, len, nblks, rv, nr;
 
-    rv = read_partition(FLASHROM_PT_BLOCK_1, &buf, &len);
+    if(!(idx = flash_part_index(p, NULL))) {
+        flog(FL_NO_INDEX);
+        return -1;
+    }
+
+    /* Don't bother copying anything if there's nothing to remove. */
+    for(i = 0; i < idx->count && !marked(idx->ent[i].id); ++i) ;
+
+    if(i == idx->count)
+        return 0;
+
+    rv = read_partition(p, &buf, &len);
     if(rv < 0) {
-        printf("Error reading partition: %d\n", rv);
+        flog(FL_READ_PART_FAILED, rv);
         return -1;
     }
 
-    rv = remove_block(FLASHROM_B1_PSOKEYS, buf, len, &nr);
+    rv = remove_marked(buf, len, &nr);
     if(rv < 0) {
-        printf("Error removing blocks\n");
+        flog(FL_REMOVE_FAILED);
         return -1;
     }
     else if(nr == 0) {
@@ -239,18 +677,303 @@ int erase_pso_keys(void) {
 
     /* Figure out how much of the flashrom we have to write... */
     nblks = rv;
-    printf("Need to write first %d blocks (and bitmap)\n", nblks);
+    flog(FL_NEED_WRITE, nblks);
+
+    rv = rewrite_partition(p, buf, len, nblks << 6);
 
-    rv = rewrite_partition(FLASHROM_PT_BLOCK_1, buf, len, nblks << 6);
     if(rv < 0) {
         return -1;
     }
 
-    free(buf);
     return nr;
 }
 
+static int mark_policy(int p, uint32_t groups, int on) {
+    int i, n = 0;
+
+    for(i = 0; i < NUM_RULES; ++i) {
+        if(scrub_policy[i].part == p && (scrub_policy[i].group & groups)) {
+            mark_blocks(scrub_policy[i].first, scrub_policy[i].last, on);
+            ++n;
+        }
+    }
+
+    return n;
+}
+
+/* Get rid of every block in the given groups (SCRUB_*). Each partition that
+   has anything to remove is compacted once and rewritten once, no matter how
+   many of the rules apply to it. Returns the number of blocks removed. */
+int flash_scrub(uint32_t groups) {
+    TRACE_ZONE("flash_scrub");
+    int p, rv, total = 0;
+
+    for(p = FLASHROM_PT_BLOCK_1; p <= FLASHROM_PT_BLOCK_2; ++p) {
+        if(!mark_policy(p, groups, 1))
+            continue;
+
+        rv = scrub_partition(p);
+        mark_policy(p, groups, 0);
+
+        if(rv < 0)
+            return -1;
+
+        total += rv;
+    }
+
+    return total;
+}
+
+int erase_pso_keys(void) {
+    return flash_scrub(SCRUB_PSO);
+}
+
+/* Rebuild the index of a cached partition after patching the cached copy to
+   match something we've just programmed, rather than throwing it away and
+   reading it all back. */
+static void cache_reindex(part_cache_t *c) {
+    if(c->idx && part_index_build(c->idx, c->buf, c->len))
+        c->idx = NULL;
+}
+
+/* Make room in a full partition by keeping only the latest good copy of each
+   block (other than id, which is about to be replaced), then add blk at the
+   end and write it all back in one go. This is built in the scratch area. */
+static int compact_partition(int p, part_cache_t *c, uint16_t id,
+                             const uint8_t blk[64]) {
+    const part_entry_t *e;
+    const uint8_t *src;
+    uint8_t *buf = arena.scratch, *bitmap;
+    int i, j, len = c->len;
+    uint16_t bid;
+
+    /* Keep the surviving blocks in the order they were originally written. */
+    memcpy(buf, c->buf, 64);
+
+    for(i = 0, j = 0; i < c->idx->used; ++i) {
+        src = c->buf + PART_SLOT_OFFSET(i);
+        bid = src[0] | (src[1] << 8);
+        e = part_index_find(c->idx, bid);
+
+        if(bid != id && e && e->slot == i)
+            memcpy(buf + PART_SLOT_OFFSET(j++), src, 64);
+    }
+
+    if(j >= c->idx->nblks) {
+        flog(FL_FULL, p);
+        return -1;
+    }
+
+    memcpy(buf + PART_SLOT_OFFSET(j++), blk, 64);
+
+    /* Build the bitmap to match; rewrite_partition blanks the rest. */
+    bitmap = buf + len - c->idx->bmlen;
+    memset(bitmap, 0xff, c->idx->bmlen);
+    memset(bitmap, 0, j >> 3);
+
+    if(j & 7)
+        bitmap[j >> 3] = 0xff >> (j & 7);
+
+    flog(FL_COMPACTED, p, c->idx->used, j);
+    return rewrite_partition(p, buf, len, (j + 1) << 6);
+}
+
+/* Write a new version of a block to a partition. The partitions are a log of
+   blocks, so this just appends the block in the next free slot and marks that
+   slot as allocated in the bitmap: a 64 byte program and a 1 byte program,
+   with no erase. Only when the partition has filled up does it get compacted
+   and rewritten. The ID and CRC in blk are filled in here. */
+int flash_write_block(int p, uint16_t id, const uint8_t blk[64]) {
+    TRACE_ZONE("flash_write_block");
+    const flash_geom_t *g = flash_geom(p);
+    part_cache_t *c;
+    uint8_t nb[64], bm;
+    int slot, bmofs, i;
+    uint16_t crc;
+
+    if(p < FLASHROM_PT_BLOCK_1 || p > FLASHROM_PT_BLOCK_2) {
+        flog(FL_BOGUS_WRITE, p);
+        return -1;
+    }
+
+    if(!(c = cache_get(p)) || !c->idx) {
+        flog(FL_NO_BLOCKS, p);
+        return -1;
+    }
+
+    memcpy(nb, blk, 64);
+    nb[0] = (uint8_t)id;
+    nb[1] = (uint8_t)(id >> 8);
+    crc = flash_block_crc(nb);
+    nb[FLASHROM_OFFSET_CRC] = (uint8_t)crc;
+    nb[FLASHROM_OFFSET_CRC + 1] = (uint8_t)(crc >> 8);
+
+    /* A slot past the end of the allocated ones should still be blank. If it
+       isn't, an earlier write got cut off part way, so treat it like there's
+       no room left and let the compaction clean it up. */
+    slot = c->idx->used;
+
+    if(slot < c->idx->nblks) {
+        for(i = 0; i < 64 && c->buf[PART_SLOT_OFFSET(slot) + i] == 0xFF; ++i) ;
+
+        if(i < 64)
+            slot = c->idx->nblks;
+    }
+
+    if(slot >= c->idx->nblks)
+        return compact_partition(p, c, id, nb);
+
+    /* Write the block before allocating it, so that losing power in between
+       leaves a dirty free slot rather than a bogus allocated block. */
+    if(fl_write(g->offset + PART_SLOT_OFFSET(slot), nb, 64) < 0) {
+        flog(FL_WRITE_BLOCK_FAILED, id, p);
+        cache_invalidate();
+        return -1;
+    }
+
+    bmofs = c->len - c->idx->bmlen + (slot >> 3);
+    bm = c->buf[bmofs] & ~(0x80 >> (slot & 7));
+
+    if(fl_write(g->offset + bmofs, &bm, 1) < 0) {
+        flog(FL_ALLOC_FAILED, id, p);
+        cache_invalidate();
+        return -1;
+    }
+
+    memcpy(c->buf + PART_SLOT_OFFSET(slot), nb, 64);
+    c->buf[bmofs] = bm;
+    cache_reindex(c);
+    return 0;
+}
+
+/* Make every copy of a block in a partition unreadable without erasing it, by
+   programming everything after the block number to zero. That leaves copies
+   with a bad CRC, which are ignored when looking up the block. For the one
+   block number where the zeroed copy would still have a good CRC, the number
+   gets zeroed too. Returns the number of copies that were changed. */
+int flash_kill_block(int p, uint16_t id) {
+    TRACE_ZONE("flash_kill_block");
+    const flash_geom_t *g = flash_geom(p);
+    part_cache_t *c;
+    uint8_t dead[64];
+    const uint8_t *blk;
+    int i, j, n = 0;
+
+    if(p < FLASHROM_PT_BLOCK_1 || p > FLASHROM_PT_BLOCK_2) {
+        flog(FL_BOGUS_WRITE, p);
+        return -1;
+    }
+
+    if(!(c = cache_get(p)) || !c->idx) {
+        flog(FL_NO_BLOCKS, p);
+        return -1;
+    }
+
+    if(!part_index_find(c->idx, id))
+        return 0;
+
+    memset(dead, 0, 64);
+    dead[0] = (uint8_t)id;
+    dead[1] = (uint8_t)(id >> 8);
+
+    if(!flash_block_crc(dead)) {
+        dead[0] = 0;
+        dead[1] = 0;
+    }
+
+    for(i = 0; i < c->idx->used; ++i) {
+        blk = c->buf + PART_SLOT_OFFSET(i);
+
+        if(blk[0] != (uint8_t)id || blk[1] != (uint8_t)(id >> 8))
+            continue;
+
+        /* Don't bother with copies that are already dead. */
+        for(j = 0; j < 64 && blk[j] == dead[j]; ++j) ;
+
+        if(j == 64)
+            continue;
+
+        if(fl_write(g->offset + PART_SLOT_OFFSET(i), dead, 64) < 0) {
+            flog(FL_WRITE_BLOCK_FAILED, id, p);
+            cache_invalidate();
+            return -1;
+        }
+
+        memcpy(c->buf + PART_SLOT_OFFSET(i), dead, 64);
+        ++n;
+    }
+
+    cache_reindex(c);
+    return n;
+}
+
+/* Put a backup of the whole flashrom back, touching as little of the flash as
+   possible. Each partition is its own erase sector, so they're compared one at
+   a time against what's on the flash now: ones that match are left alone, and
+   the rest are brought in line with flash_sync, which only erases if some bit
+   has to go from 0 back to 1. Everything that gets written is read back and
+   checked afterwards. The system and reserved partitions are left as they are,
+   since they belong to the console rather than to whoever's using it. */
+int flash_restore(const uint8_t *img, flash_plan_t *total) {
+    TRACE_ZONE("flash_restore");
+    const flash_geom_t *g;
+    part_cache_t *c;
+    flash_plan_t pl;
+    int p, offset, len, changed = 0;
+
+    total->erased = 0;
+    total->written = 0;
+    total->skipped = 0;
+
+    /* Complain (but carry on) if the backup came from some other console. */
+    if(!(c = cache_get(FLASHROM_PT_SYSTEM)))
+        return -1;
+
+    g = flash_geom(FLASHROM_PT_SYSTEM);
+
+    if(memcmp(c->buf, img + g->offset, g->len))
+        flog(FL_SYSTEM_DIFFERS);
+
+    for(p = FLASHROM_PT_BLOCK_1; p <= FLASHROM_PT_BLOCK_2; ++p) {
+        if(!(c = cache_get(p)))
+            return -1;
+
+        g = flash_geom(p);
+        offset = g->offset;
+        len = g->len;
+
+        if(!memcmp(c->buf, img + offset, len)) {
+            flog(FL_UNCHANGED, p);
+            total->skipped += len;
+            continue;
+        }
+
+        if(flash_sync(offset, img + offset, len, &pl) < 0) {
+            flog(FL_RESTORE_FAILED, p);
+            return -1;
+        }
+
+        flog(pl.erased ? FL_RESTORE_ERASED : FL_RESTORE_SKIPPED, p,
+             pl.written);
+
+        /* flash_sync threw the cache out, so this reads back the flash. */
+        if(!(c = cache_get(p)) || memcmp(c->buf, img + offset, len)) {
+            flog(FL_RESTORE_MISMATCH, p);
+            return -1;
+        }
+
+        total->erased += pl.erased;
+        total->written += pl.written;
+        total->skipped += pl.skipped;
+        ++changed;
+    }
+
+    return changed;
+}
+
 int erase_flashrom(void) {
+    TRACE_ZONE("erase_flashrom");
+
     /* Only bother with these two, as most likely whatever they're trying to
        delete is in one of them. */
     if(erase_partition(FLASHROM_PT_SETTINGS))
@@ -261,19 +984,58 @@ int erase_flashrom(void) {
     return 0;
 }
 
+/* This is the same CRC that the BIOS (and KOS) use for validating blocks. It
+   covers everything in the block but the CRC itself. */
+uint16_t flash_block_crc(const uint8_t *blk) {
+    return (uint16_t)~crc16(0xFFFF, blk, FLASHROM_OFFSET_CRC);
+}
+
+/* Find the latest valid copy of the given logical block in a partition. This
+   works the same way as flashrom_get_block() in KOS, but goes through our
+   backend so that it works on flashrom images too. When the flashrom can be
+   mapped, it's read in place. */
+int flash_get_block(int p, uint16_t id, uint8_t blk[64]) {
+    part_view_t v;
+    const uint8_t *b;
+    int bad;
+
+    if(flash_part_view(p, &v) || v.buf[16] != (uint8_t)p)
+        return -4;
+
+    b = part_view_latest(&v, id, &bad);
+
+    if(bad)
+        flog(FL_BAD_COPIES, bad, id, p);
+
+    if(!b)
+        return -1;
+
+    memcpy(blk, b, 64);
+    return 0;
+}
+
 static char cod(uint8_t c) {
     if(isprint(c))
         return (char)c;
     return '.';
 }
 
+/* Pull the serial numbers out of a PSO keys block. Returns nonzero if the block
+   doesn't look like what we'd expect, although the values are filled in either
+   way. */
+int parse_pso_keys(const uint8_t blk[64], uint32_t *v1, uint32_t *v2) {
+    *v1 = blk[14] | (blk[15] << 8) | (blk[16] << 16) | ((uint32_t)blk[17] << 24);
+    *v2 = blk[26] | (blk[27] << 8) | (blk[28] << 16) | ((uint32_t)blk[29] << 24);
+
+    return blk[4] != (uint8_t)'1' || blk[5] != (uint8_t)'S';
+}
+
 int find_pso_keys(uint32_t *v1, uint32_t *v2) {
     uint8_t blk[64];
     int rv;
-    uint32_t tmp;
 
     /* PSO Keys are stored in block 7 in the first block allocated bank. */
-    rv = flashrom_get_block(FLASHROM_PT_BLOCK_1, FLASHROM_B1_PSOKEYS, blk);
+    rv = flash_get_block(FLASHROM_PT_BLOCK_1, FLASHROM_B1_PSOKEYS, blk);
     if(rv) {
         printf("Error finding PSO keys (%d)\n", rv);
         return -1;
@@ -283,17 +1045,12 @@ int find_pso_keys(uint32_t *v1, uint32_t *v2) {
            cod(blk[5]));
 
     /* Check the block to see if it looks sane... */
-    if(blk[4] != (uint8_t)'1' || blk[5] != (uint8_t)'S') {
+    if(parse_pso_keys(blk, v1, v2)) {
         printf("Block looks incorrect, trying anyway...\n");
     }
 
-    tmp = blk[14] | (blk[15] << 8) | (blk[16] << 16) | (blk[17] << 24);
-    printf("PSOv1 Key: %08" PRIX32 "\n", tmp);
-    *v1 = tmp;
-
-    tmp = blk[26] | (blk[27] << 8) | (blk[28] << 16) | (blk[29] << 24);
-    printf("PSOv2 Key: %08" PRIX32 "\n", tmp);
-    *v2 = tmp;
+    printf("PSOv1 Key: %08" PRIX32 "\n", *v1);
+    printf("PSOv2 Key: %08" PRIX32 "\n", *v2);
 
     return 0;
 }
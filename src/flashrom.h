@@ -19,16 +19,159 @@
 #define FLASHROM_H
 
 #include <stdint.h>
+
+#ifdef _arch_dreamcast
 #include <dc/flashrom.h>
+#else
+/* These match up with the partition numbers in KOS' dc/flashrom.h. */
+#define FLASHROM_PT_SYSTEM      0
+#define FLASHROM_PT_RESERVED    1
+#define FLASHROM_PT_BLOCK_1     2
+#define FLASHROM_PT_SETTINGS    3
+#define FLASHROM_PT_BLOCK_2     4
+#define FLASHROM_OFFSET_CRC     62
+#endif
 
 #define FLASHROM_B1_PSOKEYS 0x0007
 
+/* The flashrom is 128KB, and partitions are made up of 64 byte blocks. The
+   biggest partition is 64KB. */
+#define FLASHROM_SIZE       0x20000
+#define FLASHROM_BLOCK_SIZE 64
+#define FLASHROM_MAX_PART   0x10000
+
+/* Low-level access to the flashrom. The engine in flashrom.c does all of its
+   work through one of these, so that it doesn't care whether it is talking to
+   the real flashrom on a console or to a dump of one. Offsets are relative to
+   the start of the flashrom and return values follow the KOS flashrom_*
+   functions (negative on error). If the flashrom can be read directly from
+   memory, map returns a pointer to the given range of it, otherwise it can be
+   NULL (or return NULL). */
+typedef struct flash_ops {
+    int (*info)(int part, int *offset, int *len);
+    int (*read)(int offset, void *buf, int len);
+    int (*write)(int offset, const void *buf, int len);
+    int (*erase)(int offset);
+    const uint8_t *(*map)(int offset, int len);
+} flash_ops_t;
+
+/* From partidx.h */
+struct part_index;
+struct part_view;
+
+/* Where a partition is and how its blocks are laid out. These are worked out
+   once for each backend, rather than each time something needs them. */
+typedef struct flash_geom {
+    int offset;
+    int len;
+    int bmlen;                      /* Bitmap length, in bytes */
+    int nblks;                      /* Usable block slots */
+} flash_geom_t;
+
+/* What flash_sync actually had to do to the flash. */
+typedef struct flash_plan {
+    int erased;
+    int written;
+    int skipped;
+} flash_plan_t;
+
+/* Gets told about every successful access the engine makes to the flashrom.
+   For erases, len is the size of the erased partition. */
+#define FLASH_OP_READ   0
+#define FLASH_OP_WRITE  1
+#define FLASH_OP_ERASE  2
+
+typedef void (*flash_observer_t)(int op, int offset, int len);
+
+/* Running totals for each kind of access (indexed by FLASH_OP_*), counting
+   every call that goes to the backend. Times are in microseconds. */
+typedef struct flash_op_stats {
+    uint32_t count;
+    uint32_t errors;
+    uint32_t bytes;
+    uint32_t max_us;
+    uint64_t us;
+} flash_op_stats_t;
+
+typedef struct flash_stats {
+    flash_op_stats_t op[3];
+} flash_stats_t;
+
+void flash_set_ops(const flash_ops_t *ops);
+const flash_geom_t *flash_geom(int p);
+void flash_set_observer(flash_observer_t fn);
+void flash_set_verify(int on);
+void flash_get_stats(flash_stats_t *st);
+void flash_reset_stats(void);
+int flash_read(int offset, void *buf, int len);
+int flash_sync(int offset, const uint8_t *want, int len, flash_plan_t *pl);
+int flash_get_block(int p, uint16_t id, uint8_t blk[64]);
+int flash_write_block(int p, uint16_t id, const uint8_t blk[64]);
+int flash_kill_block(int p, uint16_t id);
+const struct part_index *flash_part_index(int p, const uint8_t **buf);
+const uint8_t *flash_map_partition(int p, int *len);
+int flash_part_view(int p, struct part_view *v);
+uint16_t flash_block_crc(const uint8_t *blk);
+
 int erase_partition(int p);
 int find_pso_keys(uint32_t *v1, uint32_t *v2);
+int parse_pso_keys(const uint8_t blk[64], uint32_t *v1, uint32_t *v2);
 int read_partition(int p, uint8_t **buf, int *len);
 int remove_blocks(uint16_t bn[], int bnc, uint8_t *buf, int len, int *nr);
 int remove_block(uint16_t b, uint8_t *buf, int len, int *nr);
 int erase_flashrom(void);
+int flash_restore(const uint8_t *img, flash_plan_t *total);
 int erase_pso_keys(void);
 
+/* Groups of blocks that flash_scrub can get rid of. */
+#define SCRUB_PSO       0x00000001  /* PSO serial numbers */
+#define SCRUB_ISP       0x00000002  /* Dial-up, DNS and email settings */
+#define SCRUB_GAMES     0x00000004  /* Game settings */
+#define SCRUB_ALL       0x00000007
+
+int flash_scrub(uint32_t groups);
+
+#ifdef _arch_dreamcast
+/* From flash_kos.c */
+extern const flash_ops_t flash_kos_ops;
+#endif
+
+/* From flash_image.c */
+extern const flash_ops_t flash_image_ops;
+int flash_image_load(const char *fn);
+int flash_image_set(const uint8_t *img);
+int flash_image_save(const char *fn);
+int flash_image_save_as(const char *fn, int sparse);
+
+/* From flash_sim.c. Read and program times are per byte, erase times are per
+   sector. With realtime set, the simulator actually waits that long. */
+typedef struct flash_sim_timing {
+    uint32_t read_ns;
+    uint32_t program_ns;
+    uint32_t erase_us;
+    int realtime;
+} flash_sim_timing_t;
+
+/* Everything done to the simulated chip. Sectors are indexed by partition. */
+typedef struct flash_sim_stats {
+    uint32_t reads;
+    uint32_t read_bytes;
+    uint32_t programs;
+    uint32_t programmed[FLASHROM_PT_BLOCK_2 + 1];   /* Bytes */
+    uint32_t cleared[FLASHROM_PT_BLOCK_2 + 1];      /* Bits taken to 0 */
+    uint32_t refused;               /* Programs that tried to set a bit */
+    uint32_t erases[FLASHROM_PT_BLOCK_2 + 1];
+    uint64_t busy_ns;               /* Time the chip would have been busy */
+} flash_sim_stats_t;
+
+extern const flash_ops_t flash_sim_ops;
+int flash_sim_set(const uint8_t *img);
+const uint8_t *flash_sim_image(void);
+void flash_sim_set_timing(const flash_sim_timing_t *t);
+void flash_sim_power_cut(uint32_t n);
+int flash_sim_powered(void);
+void flash_sim_power_on(void);
+void flash_sim_get_stats(flash_sim_stats_t *st);
+void flash_sim_reset_stats(void);
+
 #endif /* !FLASHROM_H */
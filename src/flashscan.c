@@ -0,0 +1,288 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "flashrom.h"
+#include "partidx.h"
+#include "pool.h"
+#include "filelist.h"
+
+/* Bulk analyzer for flashrom dumps. Every image given (or found under a given
+   directory) is mapped into memory and run through the same partition parsing
+   that the tool itself uses, spread across all of the CPUs. A result line is
+   written out for each image as soon as it's done, so they come out in
+   whatever order the images finish in. */
+
+#define OUT_CSV     0
+#define OUT_JSON    1
+
+/* Partitions that hold blocks worth looking at. */
+static const int scan_parts[] = {
+    FLASHROM_PT_BLOCK_1, FLASHROM_PT_SETTINGS, FLASHROM_PT_BLOCK_2
+};
+
+static const char *scan_names[] = { "block1", "settings", "block2" };
+
+#define NUM_SCAN (int)(sizeof(scan_parts) / sizeof(scan_parts[0]))
+
+typedef struct scan {
+    filelist_t fl;
+    int format;
+    pthread_mutex_t out_lock;
+    char **obuf;
+    part_index_t **idx;
+} scan_t;
+
+/* Quote a string for CSV or JSON output. File names are the only thing that
+   could have anything nasty in them. */
+static int put_str(char *o, int ol, const char *str, int fmt) {
+    int i = 0;
+
+    o[i++] = '"';
+
+    for(; *str && i < ol - 3; ++str) {
+        if(*str == '"')
+            o[i++] = fmt == OUT_CSV ? '"' : '\\';
+        else if(fmt == OUT_JSON && *str == '\\')
+            o[i++] = '\\';
+
+        o[i++] = *str;
+    }
+
+    o[i++] = '"';
+    o[i] = 0;
+    return i;
+}
+
+static void scan_one(int i, int thd, void *d) {
+    scan_t *s = (scan_t *)d;
+    const char *fn = s->fl.files[i];
+    char *o = s->obuf[thd];
+    part_index_t *idx = s->idx[thd];
+    const uint8_t *img = MAP_FAILED, *blk;
+    const part_entry_t *e;
+    const char *status = "ok";
+    int fd, p, j, offset, len, n = 0, keys = 0, bad;
+    struct stat st;
+    uint32_t v1 = 0, v2 = 0;
+
+    /* Leave room for a 1021 entry histogram in each of three partitions. */
+    const int ol = 65536;
+
+    if((fd = open(fn, O_RDONLY)) < 0) {
+        status = "open-error";
+    }
+    else if(fstat(fd, &st) || st.st_size != FLASHROM_SIZE) {
+        status = "bad-size";
+    }
+    else if((img = (const uint8_t *)mmap(NULL, FLASHROM_SIZE, PROT_READ,
+                                         MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        status = "map-error";
+    }
+
+    if(fd >= 0)
+        close(fd);
+
+    if(img != MAP_FAILED) {
+        flash_image_ops.info(FLASHROM_PT_BLOCK_1, &offset, &len);
+
+        if(!part_index_build(idx, img + offset, len) &&
+           (e = part_index_find(idx, FLASHROM_B1_PSOKEYS)) && e->slot >= 0) {
+            blk = img + offset + PART_SLOT_OFFSET(e->slot);
+            keys = parse_pso_keys(blk, &v1, &v2) ? 2 : 1;
+        }
+    }
+
+    if(s->format == OUT_CSV) {
+        n = put_str(o, ol, fn, OUT_CSV);
+        n += snprintf(o + n, ol - n, ",%s,", status);
+
+        if(keys)
+            n += snprintf(o + n, ol - n, "%08" PRIX32 ",%08" PRIX32 ",%d",
+                          v1, v2, keys == 1);
+        else
+            n += snprintf(o + n, ol - n, ",,");
+    }
+    else {
+        n = snprintf(o, ol, "{\"file\":");
+        n += put_str(o + n, ol - n, fn, OUT_JSON);
+        n += snprintf(o + n, ol - n, ",\"status\":\"%s\"", status);
+
+        if(keys)
+            n += snprintf(o + n, ol - n, ",\"pso_v1\":\"%08" PRIX32 "\","
+                          "\"pso_v2\":\"%08" PRIX32 "\",\"pso_magic_ok\":%s",
+                          v1, v2, keys == 1 ? "true" : "false");
+    }
+
+    for(p = 0; p < NUM_SCAN; ++p) {
+        flash_image_ops.info(scan_parts[p], &offset, &len);
+
+        if(img == MAP_FAILED || part_index_build(idx, img + offset, len)) {
+            if(s->format == OUT_CSV)
+                n += snprintf(o + n, ol - n, ",,,,");
+            continue;
+        }
+
+        for(j = 0, bad = 0; j < idx->count; ++j) {
+            bad += idx->ent[j].bad;
+        }
+
+        if(s->format == OUT_CSV)
+            n += snprintf(o + n, ol - n, ",%d,%d,%d,", idx->used, idx->nblks,
+                          bad);
+        else
+            n += snprintf(o + n, ol - n, ",\"%s\":{\"used\":%d,\"blocks\":%d,"
+                          "\"bad\":%d,\"ids\":{", scan_names[p], idx->used,
+                          idx->nblks, bad);
+
+        for(j = 0; j < idx->count; ++j) {
+            e = &idx->ent[j];
+
+            if(s->format == OUT_CSV)
+                n += snprintf(o + n, ol - n, "%s%04X:%d", j ? " " : "",
+                              e->id, e->copies);
+            else
+                n += snprintf(o + n, ol - n, "%s\"%04X\":%d", j ? "," : "",
+                              e->id, e->copies);
+        }
+
+        if(s->format == OUT_JSON)
+            n += snprintf(o + n, ol - n, "}}");
+    }
+
+    n += snprintf(o + n, ol - n, s->format == OUT_CSV ? "\n" : "}\n");
+
+    if(img != MAP_FAILED)
+        munmap((void *)img, FLASHROM_SIZE);
+
+    pthread_mutex_lock(&s->out_lock);
+    fwrite(o, 1, n, stdout);
+    pthread_mutex_unlock(&s->out_lock);
+}
+
+static void usage(const char *argv0) {
+    printf("Usage: %s [-j threads] [-f csv|json] [-l list] [path...]\n\n"
+           "Scans flashrom dumps for PSO serial numbers, partition fill levels\n"
+           "and block number counts. Paths may be files or directories, which\n"
+           "are searched recursively. With -l, paths are also read one per\n"
+           "line from the given file (or - for stdin). JSON output is one\n"
+           "object per line.\n", argv0);
+}
+
+int main(int argc, char *argv[]) {
+    scan_t s;
+    int c, i, nthreads = pool_default_threads();
+
+    memset(&s, 0, sizeof(s));
+
+    while((c = getopt(argc, argv, "j:f:l:h")) != -1) {
+        switch(c) {
+            case 'j':
+                nthreads = atoi(optarg);
+                break;
+
+            case 'f':
+                if(!strcmp(optarg, "csv"))
+                    s.format = OUT_CSV;
+                else if(!strcmp(optarg, "json"))
+                    s.format = OUT_JSON;
+                else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+
+            case 'l':
+                if(filelist_add_list(&s.fl, optarg))
+                    return 1;
+                break;
+
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 1;
+        }
+    }
+
+    for(i = optind; i < argc; ++i) {
+        if(filelist_add_path(&s.fl, argv[i]))
+            return 1;
+    }
+
+    if(!s.fl.count) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(nthreads < 1)
+        nthreads = 1;
+    if(nthreads > s.fl.count)
+        nthreads = s.fl.count;
+
+    /* Each thread gets its own output buffer and index to work with. */
+    s.obuf = (char **)calloc(nthreads, sizeof(char *));
+    s.idx = (part_index_t **)calloc(nthreads, sizeof(part_index_t *));
+
+    if(!s.obuf || !s.idx) {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    for(i = 0; i < nthreads; ++i) {
+        s.obuf[i] = (char *)malloc(65536);
+        s.idx[i] = (part_index_t *)malloc(sizeof(part_index_t));
+
+        if(!s.obuf[i] || !s.idx[i]) {
+            printf("Out of memory\n");
+            return 1;
+        }
+    }
+
+    pthread_mutex_init(&s.out_lock, NULL);
+
+    if(s.format == OUT_CSV)
+        printf("file,status,pso_v1,pso_v2,pso_magic_ok,"
+               "block1_used,block1_blocks,block1_bad,block1_ids,"
+               "settings_used,settings_blocks,settings_bad,settings_ids,"
+               "block2_used,block2_blocks,block2_bad,block2_ids\n");
+
+    if(pool_run(nthreads, s.fl.count, scan_one, &s))
+        return 1;
+
+    fflush(stdout);
+
+    for(i = 0; i < nthreads; ++i) {
+        free(s.obuf[i]);
+        free(s.idx[i]);
+    }
+
+    filelist_free(&s.fl);
+    free(s.obuf);
+    free(s.idx);
+    pthread_mutex_destroy(&s.out_lock);
+
+    return 0;
+}
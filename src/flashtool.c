@@ -20,46 +20,40 @@
 #include <inttypes.h>
 
 #include <kos/fs.h>
+#include <arch/timer.h>
 #include <dc/video.h>
 #include <dc/maple.h>
 #include <dc/maple/controller.h>
 
 #include "fb_console.h"
+#include "input.h"
+#include "jobs.h"
 #include "flashrom.h"
-
-extern void fprint_buf(FILE *fp, const unsigned char *pkt, int len);
-
+#include "dumpfmt.h"
+#include "vmuexport.h"
+#include "wear.h"
+#include "batch.h"
+#include "flog.h"
+#include "trace.h"
+#include "utils.h"
+
+/* Wait for a button press (or chord), returning everything that's held. */
 static uint32_t wait_for_input(void) {
-    maple_device_t *dev;
-    cont_state_t *state;
+    input_event_t ev;
 
     for(;;) {
-        if((dev = maple_enum_type(0, MAPLE_FUNC_CONTROLLER)) != NULL) {
-            state = (cont_state_t *)maple_dev_status(dev);
+        input_wait(&ev);
 
-            if(state == NULL)
-                thd_pass();
-
-            if(state->buttons)
-                return state->buttons;
-        }
-
-        thd_pass();
+        if(ev.type == INPUT_PRESS)
+            return ev.held;
     }
 }
 
 static void disclaimer(void) {
-    int i;
     uint32_t buttons;
 
-    fb_init();
-
-    vid_waitvbl();
-
     /* Clear the background to an attention grabbing shade of red... */
-    for(i = 0; i < 640 * 480; ++i) {
-        vram_s[i] = 0x8000;
-    }
+    fb_clear(0x8000);
 
     fb_write_string("\n\n");
     fb_write_string("Disclaimer:\n"
@@ -88,28 +82,323 @@ static void disclaimer(void) {
 }
 
 static void draw_base_ui(void) {
+    /* Reset the console and clear the background to a nice shade of blue... */
+    fb_clear(0x0010);
+
+    /* Anything pressed before now wasn't meant for whatever comes next. */
+    input_flush();
+
+    fb_write_string("Dreamcast Flashrom Tool\n\n");
+}
+
+/* Rough amount of work each job does, for the progress bar. Scrubbing the
+   keys reads, erases and reprograms Block 1, wiping personal data does that to
+   both Block 1 and the settings, erasing the flashrom erases them both, and a
+   backup reads the whole thing. */
+#define WORK_SCRUB      (3 * 0x4000)
+#define WORK_WIPE       (3 * 0x4000 + 2 * 0x8000)
+#define WORK_ERASE      (0x8000 + 0x4000 + 128)
+#define WORK_BACKUP     0x20000
+#define WORK_VERIFY     0x4000
+#define WORK_RESTORE    0x20000
+
+/* Where the debug menu backs the flashrom up to, and restores it from. */
+#define BACKUP_FILE     "/pc/tmp/dc_flash.dcf"
+
+static int job_erase_keys(void *arg) {
+    TRACE_ZONE("job_erase_keys");
+
+    (void)arg;
+    return erase_pso_keys();
+}
+
+static int job_wipe(void *arg) {
+    TRACE_ZONE("job_wipe");
+
+    (void)arg;
+    return flash_scrub(SCRUB_ALL);
+}
+
+static int job_erase_flashrom(void *arg) {
+    TRACE_ZONE("job_erase_flashrom");
+
+    (void)arg;
+    return erase_flashrom();
+}
+
+static int job_backup(void *arg) {
+    TRACE_ZONE("job_backup");
+    FILE *fp;
+    int rv;
+
+    if(!(fp = fopen((const char *)arg, "wb"))) {
+        printf("Error opening %s\n", (const char *)arg);
+        return -1;
+    }
+
+    rv = dump_write(fp, flash_read, NULL, NULL);
+
+    if(fclose(fp))
+        return -1;
+
+    return rv;
+}
+
+/* Where a backup gets loaded to before restoring it. This stays around for
+   the whole session, rather than coming and going on the heap. */
+static uint8_t restore_img[FLASHROM_SIZE] __attribute__((aligned(32)));
+
+static int job_restore(void *arg) {
+    TRACE_ZONE("job_restore");
+    flash_plan_t pl;
+    int rv;
+
+    if((rv = dump_load((const char *)arg, restore_img)) >= 0)
+        rv = flash_restore(restore_img, &pl);
+
+    return rv;
+}
+
+static int job_verify_keys(void *arg) {
+    TRACE_ZONE("job_verify_keys");
+    uint8_t blk[64];
+
+    (void)arg;
+
+    /* Succeeds only if there are no longer any keys to find. */
+    return flash_get_block(FLASHROM_PT_BLOCK_1, FLASHROM_B1_PSOKEYS, blk) ?
+        0 : -1;
+}
+
+/* Draw a progress bar for whatever job is running, with a header line each
+   time a new job in the chain starts. */
+static void show_progress(const job_status_t *st, void *d) {
+    const char **last = (const char **)d;
+    uint32_t done, pct, ms;
+    char buf[64];
+    int i, n;
+
+    if(st->state == JOB_IDLE)
+        return;
+
+    if(st->name != *last) {
+        if(*last)
+            fb_write_string("\n");
+
+        fb_write_string(st->name);
+        fb_write_string("\n");
+        *last = st->name;
+    }
+
+    done = st->bytes_read + st->bytes_erased + st->bytes_programmed;
+    pct = st->total ? done * 100 / st->total : 0;
+
+    if(pct > 100 || st->state == JOB_DONE)
+        pct = 100;
+
+    ms = (uint32_t)timer_ms_gettime64() - st->start_ms;
+    n = pct / 5;
+
+    buf[0] = '\r';
+    buf[1] = '[';
+
+    for(i = 0; i < 20; ++i) {
+        buf[i + 2] = i < n ? '#' : '-';
+    }
+
+    sprintf(buf + 22, "] %3d%% %d.%ds", (int)pct, (int)(ms / 1000),
+            (int)(ms / 100 % 10));
+    fb_write_string(buf);
+}
+
+/* Where each run of jobs that touched the flash gets recorded. Writing the
+   ledger out to a VMU would mean making a proper VMS file for it, so it only
+   goes to dcload for now. */
+#define WEAR_LEDGER     "/pc/tmp/flash_wear.log"
+
+/* Timings of the flash work, the debug menu and drawing to the screen, written
+   out after each run of jobs so that it survives the reboot that often comes
+   next. It's Chrome trace event JSON, for chrome://tracing or Perfetto. */
+#define TRACE_FILE      "/pc/tmp/flash_trace.json"
+
+/* Write out what's been traced since the last time, and start over so that
+   there's room for the next lot. */
+static void save_trace(void) {
+    trace_save(TRACE_FILE);
+    trace_reset();
+}
+
+/* Draw a table of what's been done to the flash since the stats were last
+   reset. */
+static void show_stats(void) {
+    static const char *names[] = { "read", "write", "erase" };
+    const flash_op_stats_t *o;
+    flash_stats_t st;
+    char buf[64];
     int i;
 
-    /* Reset the console... */
-    fb_init();
+    flash_get_stats(&st);
+    fb_write_string("Flash     count      bytes   avg us   max us\n");
+
+    for(i = FLASH_OP_READ; i <= FLASH_OP_ERASE; ++i) {
+        o = &st.op[i];
+        sprintf(buf, "%-5s %9lu %10lu %8lu %8lu\n", names[i],
+                (unsigned long)o->count, (unsigned long)o->bytes,
+                o->count ? (unsigned long)(o->us / o->count) : 0UL,
+                (unsigned long)o->max_us);
+        fb_write_string(buf);
+    }
+}
+
+/* If the flash has been written to, show what it took, add it to the ledger
+   and start counting again. */
+static void log_wear(void) {
+    flash_stats_t st;
+
+    flash_get_stats(&st);
+
+    if(!st.op[FLASH_OP_WRITE].count && !st.op[FLASH_OP_ERASE].count)
+        return;
+
+    show_stats();
+
+    if(wear_append(WEAR_LEDGER, &st) < 0)
+        fb_write_string("Couldn't update the wear ledger\n");
+
+    flash_reset_stats();
+}
+
+/* Wait for everything that's been submitted to finish, showing progress as it
+   goes. Returns the result of the last job that was run. */
+static int run_jobs(void) {
+    const char *last = NULL;
+    int rv;
+
+    rv = jobs_wait(show_progress, &last);
+    fb_write_string(rv < 0 ? "\nFailed!\n" : "\n");
+    log_wear();
+    save_trace();
+    return rv;
+}
+
+/* Scripts that get run at boot instead of the menus, so that a console can be
+   done without anyone standing at it. The first one of these that exists is
+   the one that's used. See batch.h for what goes in them. */
+static const char *batch_scripts[] = {
+    "/cd/FLASHJOB.TXT",
+    "/pc/tmp/flashjob.txt"
+};
+
+#define NUM_SCRIPTS (int)(sizeof(batch_scripts) / sizeof(batch_scripts[0]))
+
+static void batch_progress(const batch_t *b, int i, void *d) {
+    const batch_step_t *st = &b->step[i];
+    char buf[64];
+
+    (void)d;
+
+    if(st->state == BATCH_PENDING) {
+        sprintf(buf, "%-8s ", batch_op_name(st->op));
+    }
+    else if(st->state == BATCH_SKIPPED) {
+        sprintf(buf, "%-8s skipped\n", batch_op_name(st->op));
+    }
+    else {
+        sprintf(buf, "%s %d.%ds\n", batch_state_name(st->state),
+                (int)(st->ms / 1000), (int)(st->ms / 100 % 10));
+    }
 
-    /* Wait for vblank. */
-    vid_waitvbl();
+    fb_write_string(buf);
+}
 
-    /* Clear the background to a nice shade of blue... */
-    for(i = 0; i < 640 * 480; ++i) {
-        vram_s[i] = 0x0010;
+/* Run the first batch script that can be found, if there is one. Returns
+   nonzero if a script was run. */
+static int run_batch(void) {
+    static batch_t b;
+    int i, rv = -1;
+
+    for(i = 0; i < NUM_SCRIPTS && rv == -1; ++i) {
+        rv = batch_load(&b, batch_scripts[i]);
     }
 
-    fb_write_string("Dreamcast Flashrom Tool\n\n");
+    if(rv == -1)
+        return 0;
+
+    draw_base_ui();
+
+    if(rv < 0) {
+        fb_write_string("Couldn't load batch script ");
+        fb_write_string(b.name);
+        fb_write_string("\nPress any button to continue\n");
+        wait_for_input();
+        return 0;
+    }
+
+    fb_write_string("Running batch script ");
+    fb_write_string(b.name);
+    fb_write_string("\n\n");
+
+    rv = batch_run(&b, batch_progress, NULL);
+    fb_write_string("\n");
+    log_wear();
+    save_trace();
+
+    fb_write_string(rv < 0 ? "\nBatch FAILED\n" : "\nBatch passed\n");
+    fb_write_string("Press START to exit\n");
+
+    while(!(wait_for_input() & CONT_START)) ;
+
+    return 1;
+}
+
+static void vmu_progress(const char *path, void *d) {
+    (void)d;
+    fb_write_string(path);
+    fb_write_string("\n");
+}
+
+/* Hex dump a partition to the dcload console. */
+static int dump_part(int p, const char *name) {
+    TRACE_ZONE("dump_part");
+    const uint8_t *part;
+    int len;
+
+    if(!(part = flash_map_partition(p, &len)))
+        return -1;
+
+    fb_write_string("Writing to console...\n");
+    printf("-----------------------------\n"
+           "Partition: %s\n"
+           "Size: %d bytes\n"
+           "-----------------------------\n", name, len);
+    fprint_hex(stdout, part, len, 1);
+    return 0;
+}
+
+static void export_saves(void) {
+    TRACE_ZONE("export_saves");
+    char buf[64];
+    int n;
+
+    fb_write_string("Dumping PSO saves from all VMUs\n");
+    n = vmu_export("PSO______*", "/pc/tmp", vmu_progress, NULL);
+
+    if(n < 0) {
+        fb_write_string("Error opening output files...\n");
+    }
+    else if(n == 0) {
+        fb_write_string("No PSO saves found!\n");
+    }
+    else {
+        sprintf(buf, "Exported %d files\n", n);
+        fb_write_string(buf);
+    }
 }
 
 static void debug_menu(void) {
-    FILE *fp;
-    file_t fh;
-    uint8_t *part;
     int len;
     uint32_t buttons;
+    char buf[64];
 
 restart_menu:
     draw_base_ui();
@@ -119,7 +408,10 @@ restart_menu:
     fb_write_string("A: Dump flashrom to /pc/tmp\n"
                     "B: Dump B1\n"
                     "X: Dump Settings\n"
-                    "Y: Dump PSO Saves to /pc/tmp\n"
+                    "Y: Dump PSO Saves from all VMUs to /pc/tmp\n"
+                    "UP: Backup, erase and verify PSO Serials\n"
+                    "DOWN: Show flash statistics\n"
+                    "RIGHT: Restore flashrom from /pc/tmp\n"
                     "START: Return\n");
 
     for(;;) {
@@ -131,116 +423,84 @@ restart_menu:
             return;
         }
         else if((buttons & CONT_A)) {
-            fb_write_string("Dumping flashrom to /pc/tmp/dc_flash.bin\n");
-            if(!(fp = fopen("/pc/tmp/dc_flash.bin", "wb"))) {
-                fb_write_string("Error opening file\n");
-                thd_sleep(1000);
-                goto restart_menu;
+            job_submit("Dumping flashrom to " BACKUP_FILE,
+                       job_backup, BACKUP_FILE, WORK_BACKUP);
+
+            if((len = run_jobs()) >= 0) {
+                sprintf(buf, "Done, %d blocks in use\n", len);
+                fb_write_string(buf);
             }
 
-            fwrite((void *)0x200000, 1, 0x20000, fp);
-            fclose(fp);
-            fb_write_string("Done\n");
             thd_sleep(2000);
             goto restart_menu;
         }
-        else if((buttons & CONT_B)) {
-            if(read_partition(FLASHROM_PT_BLOCK_1, &part, &len) < 0) {
-                fb_write_string("Error reading partition");
-                thd_sleep(1000);
+        else if((buttons & CONT_DPAD_UP)) {
+            /* Queue it all up as one chain. If any step fails, the rest of them
+               are skipped. */
+            job_submit("Backing up to " BACKUP_FILE, job_backup,
+                       BACKUP_FILE, WORK_BACKUP);
+            job_submit("Erasing PSO Serial Numbers", job_erase_keys, NULL,
+                       WORK_SCRUB);
+            job_submit("Verifying", job_verify_keys, NULL, WORK_VERIFY);
+
+            if(run_jobs() >= 0)
+                fb_write_string("Done\n");
+
+            thd_sleep(2000);
+            goto restart_menu;
+        }
+        else if((buttons & CONT_DPAD_RIGHT)) {
+            fb_write_string("\nThis will restore the flashrom from\n"
+                            BACKUP_FILE "\n"
+                            "Press A + B to confirm, START to Cancel.\n");
+
+            do {
+                buttons = wait_for_input();
+            } while(!(buttons & CONT_START) &&
+                    (buttons & (CONT_A | CONT_B)) != (CONT_A | CONT_B));
+
+            if((buttons & CONT_START))
                 goto restart_menu;
+
+            job_submit("Restoring flashrom", job_restore, BACKUP_FILE,
+                       WORK_RESTORE);
+
+            if((len = run_jobs()) >= 0) {
+                sprintf(buf, "Done, %d partition(s) changed\n", len);
+                fb_write_string(buf);
             }
 
-            fb_write_string("Writing to console...\n");
-            printf("-----------------------------\n"
-                   "Partition: Block 1\n"
-                   "Size: %d bytes\n"
-                   "-----------------------------\n", len);
-            fprint_buf(stdout, part, len);
-            free(part);
-            fb_write_string("Done\n");
             thd_sleep(2000);
             goto restart_menu;
         }
-        else if((buttons & CONT_X)) {
-            if(read_partition(FLASHROM_PT_SETTINGS, &part, &len) < 0) {
+        else if((buttons & CONT_DPAD_DOWN)) {
+            fb_write_string("\n");
+            show_stats();
+            fb_write_string("Press any button to continue\n");
+            wait_for_input();
+            goto restart_menu;
+        }
+        else if((buttons & (CONT_B | CONT_X))) {
+            if((buttons & CONT_B))
+                len = dump_part(FLASHROM_PT_BLOCK_1, "Block 1");
+            else
+                len = dump_part(FLASHROM_PT_SETTINGS, "Settings");
+
+            save_trace();
+
+            if(len < 0) {
                 fb_write_string("Error reading partition");
                 thd_sleep(1000);
                 goto restart_menu;
             }
 
-            fb_write_string("Writing to console...\n");
-            printf("-----------------------------\n"
-                   "Partition: Settings\n"
-                   "Size: %d bytes\n"
-                   "-----------------------------\n", len);
-            fprint_buf(stdout, part, len);
-            free(part);
             fb_write_string("Done\n");
             thd_sleep(2000);
             goto restart_menu;
         }
         else if((buttons & CONT_Y)) {
-            fb_write_string("Dumping PSO System File\n");
-            if((fh = fs_open("/vmu/a1/PSO______SYS", O_RDONLY)) >= 0) {
-                len = (int)fs_total(fh);
-                part = fs_mmap(fh);
-
-                if(!(fp = fopen("/pc/tmp/PSO______SYS", "wb"))) {
-                    fb_write_string("Error opening output file...\n");
-                    thd_sleep(1000);
-                    fs_close(fh);
-                    goto restart_menu;
-                }
-
-                fwrite(part, 1, len, fp);
-                fclose(fp);
-                fs_close(fh);
-            }
-            else {
-                fb_write_string("System file not found!\n");
-            }
-
-            fb_write_string("Dumping PSOv1 Guild Card File\n");
-            if((fh = fs_open("/vmu/a1/PSO______GCD", O_RDONLY)) >= 0) {
-                len = (int)fs_total(fh);
-                part = fs_mmap(fh);
-
-                if(!(fp = fopen("/pc/tmp/PSO______GCD", "wb"))) {
-                    fb_write_string("Error opening output file...\n");
-                    thd_sleep(1000);
-                    fs_close(fh);
-                    goto restart_menu;
-                }
-
-                fwrite(part, 1, len, fp);
-                fclose(fp);
-                fs_close(fh);
-            }
-            else {
-                fb_write_string("V1 Guild Card file not found!\n");
-            }
-
-            fb_write_string("Dumping PSOv2 Guild Card File\n");
-            if((fh = fs_open("/vmu/a1/PSO______2GC", O_RDONLY)) >= 0) {
-                len = (int)fs_total(fh);
-                part = fs_mmap(fh);
-
-                if(!(fp = fopen("/pc/tmp/PSO______2GC", "wb"))) {
-                    fb_write_string("Error opening output file...\n");
-                    thd_sleep(1000);
-                    fs_close(fh);
-                    goto restart_menu;
-                }
-
-                fwrite(part, 1, len, fp);
-                fclose(fp);
-                fs_close(fh);
-            }
-            else {
-                fb_write_string("V2 Guild Card file not found!\n");
-            }
-
+            export_saves();
+            save_trace();
             fb_write_string("Done\n");
             thd_sleep(2000);
             goto restart_menu;
@@ -249,7 +509,7 @@ restart_menu:
 }
 
 static void main_menu(void) {
-    uint32_t buttons = 0, last_buttons = 0;
+    uint32_t buttons = 0;
     uint32_t v1 = 0, v2 = 0;
     int rv;
     char buf[50];
@@ -260,6 +520,8 @@ restart_menu:
     fb_write_string("Press A to display PSO Serial Numbers\n"
                     "Press B to erase PSO Serial Numbers\n"
                     "Press X to erase the entire flashrom\n"
+                    "Press Y to erase serial numbers, ISP details\n"
+                    "and game settings, keeping system settings\n"
                     "Press START to exit\n");
 
     for(;;) {
@@ -272,10 +534,11 @@ restart_menu:
             /* SUPER SECRET DEBUG MENU! */
             thd_sleep(2000);
             debug_menu();
-            last_buttons = 0;
             goto restart_menu;
         }
-        else if((buttons & CONT_A) && !(last_buttons & CONT_A)) {
+        else if((buttons & CONT_A)) {
+            TRACE_ZONE("menu_show_keys");
+
             rv = find_pso_keys(&v1, &v2);
             fb_write_string("\n\n");
 
@@ -299,10 +562,8 @@ restart_menu:
                     fb_write_string("No PSOv2 Serial Number Found\n");
                 }
             }
-
-            last_buttons = buttons;
         }
-        else if((buttons & CONT_B) && !(last_buttons & CONT_B)) {
+        else if((buttons & CONT_B)) {
             fb_write_string("\n\n");
 
             fb_write_string("Are you sure you wish to erase your PSO Serial\n"
@@ -317,13 +578,12 @@ restart_menu:
                     fb_write_string("Canceled. Returning to menu in 3 "
                                     "seconds.\n");
                     thd_sleep(3000);
-                    last_buttons = 0;
                     goto restart_menu;
                 }
                 else if((buttons & (CONT_A | CONT_B)) == (CONT_A | CONT_B)) {
-                    fb_write_string("Erasing PSO Serial Numbers...\n");
-
-                    rv = erase_pso_keys();
+                    job_submit("Erasing PSO Serial Numbers...",
+                               job_erase_keys, NULL, WORK_SCRUB);
+                    rv = run_jobs();
 
                     if(rv < 0) {
                         fb_write_string("Error!\n"
@@ -341,7 +601,6 @@ restart_menu:
 
                     fb_write_string("Returning to menu in 3 seconds.\n");
                     thd_sleep(3000);
-                    last_buttons = 0;
                     goto restart_menu;
                 }
             }
@@ -358,18 +617,57 @@ restart_menu:
                 fb_write_string("No PSO Serial Numbers Found!\n"
                                 "Returning to menu in 3 seconds.\n");
                 thd_sleep(3000);
-                last_buttons = 0;
                 goto restart_menu;
             }
             else {
                 fb_write_string("Done!\n"
                                 "Returning to menu in 3 seconds.\n");
                 thd_sleep(3000);
-                last_buttons = 0;
                 goto restart_menu;
             }
         }
-        else if((buttons & CONT_X) && !(last_buttons & CONT_X)) {
+        else if((buttons & CONT_Y)) {
+            fb_write_string("\n\n");
+            fb_write_string("Are you sure you wish to erase your PSO Serial\n"
+                            "Numbers, ISP details and game settings?\n"
+                            "Press A + B to confirm, START to Cancel.\n"
+                            "This cannot be undone!\n");
+
+            for(;;) {
+                buttons = wait_for_input();
+
+                if((buttons & CONT_START)) {
+                    fb_write_string("Canceled. Returning to menu in 3 "
+                                    "seconds.\n");
+                    thd_sleep(3000);
+                    goto restart_menu;
+                }
+                else if((buttons & (CONT_A | CONT_B)) == (CONT_A | CONT_B)) {
+                    job_submit("Erasing personal data...", job_wipe, NULL,
+                               WORK_WIPE);
+                    rv = run_jobs();
+
+                    if(rv < 0) {
+                        fb_write_string("Error!\n"
+                                        "Rebooting in 3 seconds...\n");
+                        thd_sleep(3000);
+                        arch_reboot();
+                    }
+                    else if(rv == 0) {
+                        fb_write_string("Nothing to erase.\n");
+                    }
+                    else {
+                        sprintf(buf, "Erased %d blocks\n", rv);
+                        fb_write_string(buf);
+                    }
+
+                    fb_write_string("Returning to menu in 3 seconds.\n");
+                    thd_sleep(3000);
+                    goto restart_menu;
+                }
+            }
+        }
+        else if((buttons & CONT_X)) {
             fb_write_string("\n\n");
             fb_write_string("Are you sure you wish to erase your flashrom?\n"
                             "Press A + B to confirm, START to Cancel.\n"
@@ -382,13 +680,13 @@ restart_menu:
                     fb_write_string("Canceled. Returning to menu in 3 "
                                     "seconds.\n");
                     thd_sleep(3000);
-                    last_buttons = 0;
                     goto restart_menu;
                 }
                 else if((buttons & (CONT_A | CONT_B)) == (CONT_A | CONT_B)) {
-                    fb_write_string("Erasing flashrom...\n");
+                    job_submit("Erasing flashrom...", job_erase_flashrom, NULL,
+                               WORK_ERASE);
 
-                    if(erase_flashrom())
+                    if(run_jobs() < 0)
                         fb_write_string("Error!\n");
                     else
                         fb_write_string("Flashrom erased successfully\n");
@@ -404,7 +702,34 @@ restart_menu:
 }
 
 int main(int argc, char *argv[]) {
-    disclaimer();
-    main_menu();
+    if(input_init()) {
+        printf("Couldn't start input thread!\n");
+        return 1;
+    }
+
+    /* Engine messages go out to the host as raw records, to be turned back
+       into text with flogdump. Without dcload, they end up on stdout. */
+    flog_start("/pc/tmp/flash.flog");
+    trace_enable(1);
+
+    /* Read back everything that gets written, so that a bad write shows up as
+       a failed job rather than a corrupt flashrom later on. */
+    flash_set_verify(1);
+
+    if(jobs_init()) {
+        printf("Couldn't start flash worker thread!\n");
+        return 1;
+    }
+
+    /* A batch script stands in for the disclaimer and the menus. Whoever
+       wrote it had to arm it to get it to change anything. */
+    if(!run_batch()) {
+        disclaimer();
+        main_menu();
+    }
+
+    save_trace();
+    flog_stop();
+    input_shutdown();
     return 0;
 }
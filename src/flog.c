@@ -0,0 +1,294 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _arch_dreamcast
+#include <arch/irq.h>
+#include <arch/timer.h>
+#include <kos/thread.h>
+#else
+#include <time.h>
+#endif
+
+#include "flog.h"
+
+/* The ring of records. Anyone can add to it, but only one drain runs at a
+   time. head is the next record to be handed out and tail is the next one to
+   be drained; both only ever count up, and get masked down to a slot. Each
+   slot's seq is set to one past the record's number once it's been filled in,
+   so the drain can tell a slot that's been handed out but not written yet. */
+#define RING_LEN    1024
+#define RING_MASK   (RING_LEN - 1)
+
+typedef struct slot {
+    uint32_t seq;
+    flog_rec_t rec;
+} slot_t;
+
+static slot_t ring[RING_LEN];
+static uint32_t head, tail, dropped;
+static int draining;
+static int level = FLOG_DEBUG;
+
+#ifdef _arch_dreamcast
+/* There's only the one CPU, so with interrupts off (and thread switches with
+   them) nothing else can get in. None of this is ever held for more than a few
+   instructions. */
+static int reserve(uint32_t *h) {
+    int irqs = irq_disable(), rv = 0;
+
+    if(head - tail >= RING_LEN) {
+        ++dropped;
+        rv = -1;
+    }
+    else {
+        *h = head++;
+    }
+
+    irq_restore(irqs);
+    return rv;
+}
+
+static void commit(slot_t *s, uint32_t h) {
+    int irqs = irq_disable();
+    s->seq = h + 1;
+    irq_restore(irqs);
+}
+
+static uint32_t load_seq(const slot_t *s) {
+    return *(volatile const uint32_t *)&s->seq;
+}
+
+static void release(uint32_t t) {
+    int irqs = irq_disable();
+    tail = t;
+    irq_restore(irqs);
+}
+
+static uint32_t take_dropped(void) {
+    int irqs = irq_disable();
+    uint32_t rv = dropped;
+
+    dropped = 0;
+    irq_restore(irqs);
+    return rv;
+}
+
+static int start_drain(void) {
+    int irqs = irq_disable(), rv = !draining;
+
+    draining = 1;
+    irq_restore(irqs);
+    return rv;
+}
+
+static void end_drain(void) {
+    draining = 0;
+}
+
+static uint32_t now_us(void) {
+    return (uint32_t)timer_us_gettime64();
+}
+#else
+static int reserve(uint32_t *h) {
+    uint32_t t, n = __atomic_load_n(&head, __ATOMIC_RELAXED);
+
+    do {
+        t = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+
+        if(n - t >= RING_LEN) {
+            __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+            return -1;
+        }
+    } while(!__atomic_compare_exchange_n(&head, &n, n + 1, 1, __ATOMIC_RELAXED,
+                                         __ATOMIC_RELAXED));
+
+    *h = n;
+    return 0;
+}
+
+static void commit(slot_t *s, uint32_t h) {
+    __atomic_store_n(&s->seq, h + 1, __ATOMIC_RELEASE);
+}
+
+static uint32_t load_seq(const slot_t *s) {
+    return __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+}
+
+static void release(uint32_t t) {
+    __atomic_store_n(&tail, t, __ATOMIC_RELEASE);
+}
+
+static uint32_t take_dropped(void) {
+    return __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+}
+
+static int start_drain(void) {
+    return !__atomic_exchange_n(&draining, 1, __ATOMIC_ACQUIRE);
+}
+
+static void end_drain(void) {
+    __atomic_store_n(&draining, 0, __ATOMIC_RELEASE);
+}
+
+static uint32_t now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+#endif
+
+/* Only messages at or below this level are kept. */
+void flog_set_level(int l) {
+    level = l;
+}
+
+/* Log one of the messages in flog.h, with however many int arguments it
+   takes. */
+void flog(int id, ...) {
+    const flog_msg_t *m = &flog_msgs[id];
+    slot_t *s;
+    uint32_t h;
+    va_list ap;
+    int i;
+
+    if(m->level > level || reserve(&h))
+        return;
+
+    s = &ring[h & RING_MASK];
+    s->rec.id = (uint16_t)id;
+    s->rec.level = (uint8_t)m->level;
+    s->rec.nargs = (uint8_t)m->nargs;
+    s->rec.time_us = now_us();
+
+    va_start(ap, id);
+
+    for(i = 0; i < FLOG_MAX_ARGS; ++i) {
+        s->rec.args[i] = i < m->nargs ? va_arg(ap, int) : 0;
+    }
+
+    va_end(ap);
+    commit(s, h);
+}
+
+static int put_rec(FILE *fp, const flog_rec_t *r, int raw) {
+    if(raw)
+        return fwrite(r, sizeof(flog_rec_t), 1, fp) == 1 ? 0 : -1;
+
+    return flog_print(fp, r);
+}
+
+/* Write out everything that's been logged so far, either as text or as raw
+   records. Stops at the first record that's still being filled in. Returns the
+   number of records written, or -1 on error. */
+int flog_drain(FILE *fp, int raw) {
+    flog_rec_t r;
+    uint32_t t, n;
+    int count = 0, rv = 0;
+
+    if(!start_drain())
+        return 0;
+
+    t = tail;
+
+    while(load_seq(&ring[t & RING_MASK]) == t + 1) {
+        r = ring[t & RING_MASK].rec;
+        release(++t);
+
+        if((rv = put_rec(fp, &r, raw)) < 0)
+            break;
+
+        ++count;
+    }
+
+    /* Let whoever's reading know that there's a gap. */
+    if(rv >= 0 && (n = take_dropped())) {
+        memset(&r, 0, sizeof(r));
+        r.id = FL_DROPPED;
+        r.level = FLOG_WARN;
+        r.nargs = 1;
+        r.time_us = now_us();
+        r.args[0] = (int32_t)n;
+        rv = put_rec(fp, &r, raw);
+    }
+
+    fflush(fp);
+    end_drain();
+    return rv < 0 ? -1 : count;
+}
+
+#ifdef _arch_dreamcast
+/* On the console, the ring is drained by a thread that only gets to run when
+   nothing more important wants the CPU. Raw records go to a file when one can
+   be opened (usually over dcload), and text goes to stdout otherwise. */
+static kthread_t *drain_thd;
+static FILE *drain_fp;
+static volatile int stopping;
+
+static void *drain_thread(void *d) {
+    (void)d;
+
+    while(!stopping) {
+        if(drain_fp)
+            flog_drain(drain_fp, 1);
+        else
+            flog_drain(stdout, 0);
+
+        thd_sleep(100);
+    }
+
+    return NULL;
+}
+
+int flog_start(const char *fn) {
+    if(fn && (drain_fp = fopen(fn, "wb")) &&
+       fwrite(FLOG_MAGIC, 8, 1, drain_fp) != 1) {
+        fclose(drain_fp);
+        drain_fp = NULL;
+    }
+
+    stopping = 0;
+
+    if(!(drain_thd = thd_create(0, drain_thread, NULL)))
+        return -1;
+
+    thd_set_prio(drain_thd, PRIO_DEFAULT + 5);
+    return 0;
+}
+
+void flog_stop(void) {
+    if(drain_thd) {
+        stopping = 1;
+        thd_join(drain_thd, NULL);
+        drain_thd = NULL;
+    }
+
+    if(drain_fp) {
+        flog_drain(drain_fp, 1);
+        fclose(drain_fp);
+        drain_fp = NULL;
+    }
+    else {
+        flog_drain(stdout, 0);
+    }
+}
+#endif
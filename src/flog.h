@@ -0,0 +1,114 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLOG_H
+#define FLOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Logging for the flashrom engine. Rather than formatting anything (which over
+   dcload means a round trip to the host for every line), flog() just drops a
+   small binary record into a ring buffer: the message number, a timestamp and
+   up to six integer arguments. The ring gets drained later on, either as text
+   or as the raw records, and flogdump turns files of raw records back into
+   text on the host. If the ring fills up, new records are dropped and counted
+   rather than waiting for room. */
+
+#define FLOG_ERROR      0
+#define FLOG_WARN       1
+#define FLOG_INFO       2
+#define FLOG_DEBUG      3
+
+#define FLOG_MAX_ARGS   6
+
+/* Records are 32 bytes, and are written to files as they are in memory (which
+   is little endian on both the Dreamcast and anything we'd decode them on). */
+typedef struct flog_rec {
+    uint16_t id;
+    uint8_t level;
+    uint8_t nargs;
+    uint32_t time_us;
+    int32_t args[FLOG_MAX_ARGS];
+} flog_rec_t;
+
+/* Files of raw records start with this. */
+#define FLOG_MAGIC      "DCFLOG01"
+
+/* Every message that can be logged, along with its level and how many
+   arguments it takes. These numbers end up in log files, so only ever add new
+   ones to the end. */
+typedef struct flog_msg {
+    int level;
+    int nargs;
+    const char *fmt;
+} flog_msg_t;
+
+#define FL_DROPPED              0
+#define FL_GEOM_BOGUS           1
+#define FL_VERIFY_FAILED        2
+#define FL_READ_FAILED          3
+#define FL_BOGUS_DELETE         4
+#define FL_NO_PARTITION         5
+#define FL_PARTITION            6
+#define FL_DELETE_PART          7
+#define FL_WRITE_HEADER         8
+#define FL_DELETE_AT            9
+#define FL_WRITE_AT_FAILED      10
+#define FL_BOGUS_LENGTH         11
+#define FL_BOGUS_AMOUNT         12
+#define FL_REWRITE_FAILED       13
+#define FL_REWRITE_ERASED       14
+#define FL_REWRITE_SKIPPED      15
+#define FL_BAD_DUMP             16
+#define FL_EMPTY                17
+#define FL_BAD_CRCS             18
+#define FL_REMOVING             19
+#define FL_NO_INDEX             20
+#define FL_READ_PART_FAILED     21
+#define FL_REMOVE_FAILED        22
+#define FL_NEED_WRITE           23
+#define FL_FULL                 24
+#define FL_COMPACTED            25
+#define FL_BOGUS_WRITE          26
+#define FL_NO_BLOCKS            27
+#define FL_WRITE_BLOCK_FAILED   28
+#define FL_ALLOC_FAILED         29
+#define FL_SYSTEM_DIFFERS       30
+#define FL_UNCHANGED            31
+#define FL_RESTORE_FAILED       32
+#define FL_RESTORE_ERASED       33
+#define FL_RESTORE_SKIPPED      34
+#define FL_RESTORE_MISMATCH     35
+#define FL_BAD_COPIES           36
+
+/* From flogmsg.c */
+extern const flog_msg_t flog_msgs[];
+extern const int flog_nmsgs;
+int flog_print(FILE *fp, const flog_rec_t *r);
+
+/* From flog.c */
+void flog(int id, ...);
+void flog_set_level(int level);
+int flog_drain(FILE *fp, int raw);
+
+#ifdef _arch_dreamcast
+int flog_start(const char *fn);
+void flog_stop(void);
+#endif
+
+#endif /* !FLOG_H */
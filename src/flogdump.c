@@ -0,0 +1,121 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "flog.h"
+
+/* Turns a file of raw log records from the console back into text. The
+   records are pulled apart byte by byte, so this works the same whatever the
+   host's byte order or struct layout is. */
+
+static const char levels[] = "EWID";
+
+static void usage(const char *argv0) {
+    printf("Usage: %s [-l level] file...\n"
+           "  -l level   Only show messages up to this level (0 = errors, "
+           "3 = debug)\n", argv0);
+}
+
+static uint32_t get32(const uint8_t *b) {
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static void parse_rec(const uint8_t *b, flog_rec_t *r) {
+    int i;
+
+    r->id = b[0] | (b[1] << 8);
+    r->level = b[2];
+    r->nargs = b[3];
+    r->time_us = get32(b + 4);
+
+    for(i = 0; i < FLOG_MAX_ARGS; ++i) {
+        r->args[i] = (int32_t)get32(b + 8 + (i << 2));
+    }
+}
+
+static int dump_file(const char *fn, int max) {
+    uint8_t b[sizeof(flog_rec_t)];
+    flog_rec_t r;
+    FILE *fp;
+    size_t n;
+    int rv = 0;
+
+    if(!(fp = fopen(fn, "rb"))) {
+        printf("Cannot open %s\n", fn);
+        return -1;
+    }
+
+    if(fread(b, 8, 1, fp) != 1 || memcmp(b, FLOG_MAGIC, 8)) {
+        printf("%s isn't a flashrom log\n", fn);
+        fclose(fp);
+        return -1;
+    }
+
+    while((n = fread(b, 1, sizeof(b), fp)) == sizeof(b)) {
+        parse_rec(b, &r);
+
+        if(r.level > max)
+            continue;
+
+        printf("[%5u.%06u] %c ", (unsigned)(r.time_us / 1000000),
+               (unsigned)(r.time_us % 1000000),
+               r.level < 4 ? levels[r.level] : '?');
+        flog_print(stdout, &r);
+    }
+
+    /* The console may not have been done writing when the file was copied. */
+    if(n) {
+        printf("%s: partial record at the end\n", fn);
+        rv = -1;
+    }
+
+    fclose(fp);
+    return rv;
+}
+
+int main(int argc, char *argv[]) {
+    int c, i, max = FLOG_DEBUG, rv = 0;
+
+    while((c = getopt(argc, argv, "l:h")) != -1) {
+        switch(c) {
+            case 'l':
+                max = atoi(optarg);
+                break;
+
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if(optind == argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    for(i = optind; i < argc; ++i) {
+        if(dump_file(argv[i], max))
+            rv = 1;
+    }
+
+    return rv;
+}
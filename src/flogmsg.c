@@ -0,0 +1,81 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "flog.h"
+
+/* Indexed by the FL_* numbers in flog.h. Every argument is an int. */
+const flog_msg_t flog_msgs[] = {
+    { FLOG_WARN, 1, "%d log records were dropped" },
+    { FLOG_ERROR, 1, "Partition %d has bogus geometry" },
+    { FLOG_ERROR, 1, "Verify failed at offset %d" },
+    { FLOG_ERROR, 1, "Read flashrom returns %d" },
+    { FLOG_ERROR, 1, "Request to delete a bogus partition: %d" },
+    { FLOG_ERROR, 0, "Error finding partition!" },
+    { FLOG_INFO, 3, "Partition %d: Offset: %d, length: %d" },
+    { FLOG_INFO, 2, "Flashrom delete of partition %d returned %d" },
+    { FLOG_INFO, 1, "Write flashrom returned %d" },
+    { FLOG_INFO, 2, "Flashrom delete at %d returned %d" },
+    { FLOG_ERROR, 2, "Write flashrom at %d returned %d" },
+    { FLOG_ERROR, 0, "Bogus partition length! Bailing out." },
+    { FLOG_ERROR, 0, "Bogus amount of blocks to rewrite!" },
+    { FLOG_ERROR, 1, "Error rewriting partition %d" },
+    { FLOG_INFO, 3, "Partition %d: erased, programmed %d bytes, saved %d "
+      "bytes" },
+    { FLOG_INFO, 3, "Partition %d: erase skipped, programmed %d bytes, saved "
+      "%d bytes" },
+    { FLOG_ERROR, 0, "Partition dump looks bad..." },
+    { FLOG_INFO, 0, "Partition is empty, nothing to do." },
+    { FLOG_WARN, 2, "%d of %d blocks have a bad CRC" },
+    { FLOG_DEBUG, 3, "Removing block %d (%d so far): blknum: %d" },
+    { FLOG_ERROR, 0, "Error reading partition" },
+    { FLOG_ERROR, 1, "Error reading partition: %d" },
+    { FLOG_ERROR, 0, "Error removing blocks" },
+    { FLOG_INFO, 1, "Need to write first %d blocks (and bitmap)" },
+    { FLOG_ERROR, 1, "Partition %d is full!" },
+    { FLOG_INFO, 3, "Partition %d: compacted %d blocks down to %d" },
+    { FLOG_ERROR, 1, "Request to write to a bogus partition: %d" },
+    { FLOG_ERROR, 1, "Partition %d has no block data" },
+    { FLOG_ERROR, 2, "Error writing block %d to partition %d" },
+    { FLOG_ERROR, 2, "Error allocating block %d in partition %d" },
+    { FLOG_WARN, 0, "Warning: backup has a different system partition" },
+    { FLOG_INFO, 1, "Partition %d: unchanged" },
+    { FLOG_ERROR, 1, "Error restoring partition %d" },
+    { FLOG_INFO, 2, "Partition %d: erased, programmed %d bytes" },
+    { FLOG_INFO, 2, "Partition %d: erase skipped, programmed %d bytes" },
+    { FLOG_ERROR, 1, "Partition %d doesn't match the backup after restoring!" },
+    { FLOG_WARN, 3, "%d copies of block %d in partition %d have a bad CRC" }
+};
+
+const int flog_nmsgs = (int)(sizeof(flog_msgs) / sizeof(flog_msgs[0]));
+
+/* Write out a record as a line of text. Unused arguments are zero, and the
+   formats only ever use as many as they have. */
+int flog_print(FILE *fp, const flog_rec_t *r) {
+    const int32_t *a = r->args;
+
+    if(r->id >= flog_nmsgs)
+        return fprintf(fp, "Unknown log message %d\n", r->id);
+
+    if(fprintf(fp, flog_msgs[r->id].fmt, (int)a[0], (int)a[1], (int)a[2],
+               (int)a[3], (int)a[4], (int)a[5]) < 0)
+        return -1;
+
+    return fputc('\n', fp) == EOF ? -1 : 0;
+}
@@ -0,0 +1,34 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HOST_DC_BIOSFONT_H
+#define HOST_DC_BIOSFONT_H
+
+/* Just enough of the KOS headers to build fb_console.c on a host, for the
+   benchmarks. The glyphs that come out of this aren't the real BIOS font. */
+#include <stdint.h>
+
+typedef uint8_t uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+
+#define BFONT_CODE_ISO8859_1    0
+
+void bfont_set_encoding(uint8 enc);
+int bfont_draw(void *buffer, uint32 bufwidth, uint32 opaque, uint32 c);
+
+#endif /* !HOST_DC_BIOSFONT_H */
@@ -0,0 +1,56 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include <dc/biosfont.h>
+#include <dc/video.h>
+#include <dc/sq.h>
+
+/* Host stand-ins for the bits of KOS that fb_console.c uses. The "screen" is
+   just a buffer in memory, and the font is a made up pattern that's different
+   for each character so that rendering does the same amount of work. */
+
+static uint16 screen[640 * 480];
+uint16 *vram_s = screen;
+
+void bfont_set_encoding(uint8 enc) {
+    (void)enc;
+}
+
+int bfont_draw(void *buffer, uint32 bufwidth, uint32 opaque, uint32 c) {
+    uint16 *b = (uint16 *)buffer;
+    int x, y;
+
+    for(y = 0; y < 24; ++y) {
+        for(x = 0; x < 12; ++x) {
+            if(((x * 7 + y * 3 + c) % 5) == 0)
+                b[y * bufwidth + x] = 0xFFFF;
+            else if(opaque)
+                b[y * bufwidth + x] = 0x0000;
+        }
+    }
+
+    return 0;
+}
+
+void vid_waitvbl(void) {
+}
+
+void *sq_cpy(void *dest, const void *src, size_t n) {
+    return memcpy(dest, src, n);
+}
@@ -0,0 +1,462 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "flashrom.h"
+#include "partidx.h"
+#include "dumpfmt.h"
+#include "utils.h"
+#include "wear.h"
+#include "batch.h"
+#include "flog.h"
+#include "trace.h"
+
+/* Host version of the tool. This runs the same engine as the console version
+   does, but on a dump of the flashrom rather than the real thing. */
+
+static const char *part_names[] = {
+    "system", "reserved", "block1", "settings", "block2"
+};
+
+static void usage(const char *argv0) {
+    printf("Usage: %s [-v] [-c] [-s] [-w ledger] [-t trace] [-o output] image "
+           "command [args]\n\n"
+           "Commands:\n"
+           "  info            Show the partitions in the image\n"
+           "  keys            Display PSO serial numbers\n"
+           "  dump partition  Hex dump a partition\n"
+           "  blocks partition [id...]\n"
+           "                  List the blocks in a partition, or show the\n"
+           "                  latest copy of the given blocks\n"
+           "  write partition id file\n"
+           "                  Write a new copy of a block, with up to 60\n"
+           "                  bytes of data from file\n"
+           "  kill partition id\n"
+           "                  Make every copy of a block unreadable\n"
+           "  erase-keys      Erase PSO serial numbers\n"
+           "  scrub [group...]\n"
+           "                  Remove the blocks in the given groups (pso,\n"
+           "                  isp, games), or in all of them, leaving\n"
+           "                  everything else alone\n"
+           "  erase           Erase the settings and block1 partitions\n"
+           "  restore backup  Restore the block partitions from a backup,\n"
+           "                  only rewriting the ones that differ\n"
+           "  batch script    Run a batch script on the image, like the\n"
+           "                  console does at boot (see src/batch.h)\n"
+           "  pack output     Save the image as a sparse dump\n"
+           "  unpack output   Save the image as a raw 128KB dump\n\n"
+           "Images may be raw or sparse dumps (as written by the debug menu).\n"
+           "Commands that modify the image write it back in place unless an\n"
+           "output file is given with -o. Repeated lines in dumps are shown\n"
+           "as a single '*' unless -v is given. With -c, everything written\n"
+           "to the image is read back and checked. With -s, counts of what\n"
+           "was done to the image are shown at the end, and -w appends them\n"
+           "to a wear ledger file. With -t, how long each part of the\n"
+           "command took is written out as Chrome trace event JSON.\n",
+           argv0);
+}
+
+static void show_stats(void) {
+    static const char *names[] = { "read", "write", "erase" };
+    const flash_op_stats_t *o;
+    flash_stats_t st;
+    int i;
+
+    flash_get_stats(&st);
+    printf("Flash     count      bytes   errors   total us   max us\n");
+
+    for(i = FLASH_OP_READ; i <= FLASH_OP_ERASE; ++i) {
+        o = &st.op[i];
+        printf("%-5s %9" PRIu32 " %10" PRIu32 " %8" PRIu32 " %10" PRIu64
+               " %8" PRIu32 "\n", names[i], o->count, o->bytes, o->errors,
+               o->us, o->max_us);
+    }
+}
+
+static int parse_part(const char *s) {
+    int i;
+    char *end;
+
+    for(i = 0; i < 5; ++i) {
+        if(!strcmp(s, part_names[i]))
+            return i;
+    }
+
+    i = (int)strtol(s, &end, 0);
+    if(*end || i < FLASHROM_PT_SYSTEM || i > FLASHROM_PT_BLOCK_2)
+        return -1;
+
+    return i;
+}
+
+static int show_info(void) {
+    const part_index_t *idx;
+    const uint8_t *buf;
+    int i, offset, len;
+
+    for(i = FLASHROM_PT_SYSTEM; i <= FLASHROM_PT_BLOCK_2; ++i) {
+        if(flash_image_ops.info(i, &offset, &len))
+            return -1;
+
+        printf("%-8s offset: 0x%05X length: %6d ", part_names[i], offset, len);
+
+        if(!(idx = flash_part_index(i, &buf)))
+            printf("(no block data)\n");
+        else
+            printf("blocks used: %d/%d, %d distinct, %d bad\n", idx->used,
+                   idx->nblks, idx->count, part_validate(buf, len));
+    }
+
+    return 0;
+}
+
+static int show_blocks(int p, int argc, char *argv[]) {
+    const part_index_t *idx;
+    const part_entry_t *e;
+    const uint8_t *buf;
+    int i;
+    char *end;
+    uint16_t id;
+
+    if(!(idx = flash_part_index(p, &buf))) {
+        printf("Partition %s has no block data\n", part_names[p]);
+        return -1;
+    }
+
+    /* With no block numbers given, list everything in the partition. */
+    if(!argc) {
+        printf("Block  Copies  Bad  Latest\n");
+
+        for(i = 0; i < idx->count; ++i) {
+            e = &idx->ent[i];
+            printf("%04X   %6d  %3d  %6d\n", e->id, e->copies, e->bad, e->slot);
+        }
+
+        return 0;
+    }
+
+    for(i = 0; i < argc; ++i) {
+        id = (uint16_t)strtoul(argv[i], &end, 0);
+
+        if(*end || !(e = part_index_find(idx, id)) || e->slot < 0) {
+            printf("Block %s: not found\n", argv[i]);
+            continue;
+        }
+
+        printf("Block %04X: slot %d (%d older copies)\n", id, e->slot,
+               e->copies - 1);
+        fprint_buf(stdout, buf + PART_SLOT_OFFSET(e->slot), 64);
+    }
+
+    return 0;
+}
+
+/* Block numbers are 16 bits, in decimal or with a 0x in front for hex. */
+static int parse_id(const char *s, uint16_t *id) {
+    unsigned long v;
+    char *end;
+
+    v = strtoul(s, &end, 0);
+    if(!*s || *end || v > 0xFFFF) {
+        printf("Bad block number: %s\n", s);
+        return -1;
+    }
+
+    *id = (uint16_t)v;
+    return 0;
+}
+
+static int write_block(int p, const char *ids, const char *fn) {
+    uint8_t blk[64];
+    FILE *fp;
+    size_t n;
+    uint16_t id;
+
+    if(parse_id(ids, &id))
+        return -1;
+
+    if(!(fp = fopen(fn, "rb"))) {
+        printf("Error opening %s\n", fn);
+        return -1;
+    }
+
+    /* Anything short of a full block is left as 0xFF, like the BIOS does. */
+    memset(blk, 0xFF, 64);
+    n = fread(blk + 2, 1, FLASHROM_OFFSET_CRC - 2, fp);
+
+    if(ferror(fp) || !n) {
+        printf("Error reading %s\n", fn);
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+
+    return flash_write_block(p, id, blk);
+}
+
+static int restore(const char *fn) {
+    static uint8_t backup[FLASHROM_SIZE];
+    flash_plan_t pl;
+    int rv;
+
+    if(dump_load(fn, backup) < 0)
+        return -1;
+
+    rv = flash_restore(backup, &pl);
+    flog_drain(stdout, 0);
+
+    if(rv >= 0)
+        printf("Restored %d partition(s): %d erased, %d bytes programmed, "
+               "%d bytes left alone\n", rv, pl.erased, pl.written, pl.skipped);
+
+    return rv;
+}
+
+static int scrub(int argc, char *argv[]) {
+    static const char *groups[] = { "pso", "isp", "games" };
+    uint32_t mask = argc ? 0 : SCRUB_ALL;
+    int i, j, rv;
+
+    for(i = 0; i < argc; ++i) {
+        for(j = 0; j < 3 && strcmp(argv[i], groups[j]); ++j) ;
+
+        if(j == 3) {
+            printf("Unknown group %s\n", argv[i]);
+            return -1;
+        }
+
+        mask |= 1 << j;
+    }
+
+    rv = flash_scrub(mask);
+    flog_drain(stdout, 0);
+
+    if(rv >= 0)
+        printf("Removed %d block(s)\n", rv);
+
+    return rv;
+}
+
+static void batch_progress(const batch_t *b, int i, void *d) {
+    const batch_step_t *st = &b->step[i];
+
+    (void)d;
+    flog_drain(stdout, 0);
+
+    if(st->state != BATCH_PENDING)
+        printf("Step %d: %s %s (%d, %" PRIu32 " ms)\n", i + 1,
+               batch_op_name(st->op), batch_state_name(st->state), st->result,
+               st->ms);
+}
+
+static int run_batch(const char *fn) {
+    static batch_t b;
+
+    if(batch_load(&b, fn)) {
+        printf("Couldn't load batch script %s\n", fn);
+        return -1;
+    }
+
+    return batch_run(&b, batch_progress, NULL);
+}
+
+int main(int argc, char *argv[]) {
+    const char *argv0 = argv[0], *out = NULL, *ledger = NULL, *trace = NULL, *img;
+    const char *cmd;
+    flash_stats_t st;
+    uint32_t v1, v2;
+    uint16_t id;
+    const uint8_t *part;
+    int c, p, len, rv, modified = 0, squeeze = 1, stats = 0;
+
+    while((c = getopt(argc, argv, "o:vcsw:t:h")) != -1) {
+        switch(c) {
+            case 'v':
+                squeeze = 0;
+                break;
+
+            case 'o':
+                out = optarg;
+                break;
+
+            case 'c':
+                flash_set_verify(1);
+                break;
+
+            case 's':
+                stats = 1;
+                break;
+
+            case 'w':
+                ledger = optarg;
+                break;
+
+            case 't':
+                trace = optarg;
+                trace_enable(1);
+                break;
+
+            default:
+                usage(argv0);
+                return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if(argc - optind < 2) {
+        usage(argv0);
+        return 1;
+    }
+
+    img = argv[optind];
+    cmd = argv[optind + 1];
+
+    if(flash_image_load(img))
+        return 1;
+
+    flash_set_ops(&flash_image_ops);
+    flash_reset_stats();
+
+    if(!strcmp(cmd, "info")) {
+        rv = show_info();
+    }
+    else if(!strcmp(cmd, "keys")) {
+        rv = find_pso_keys(&v1, &v2);
+    }
+    else if(!strcmp(cmd, "dump")) {
+        if(argc - optind < 3 || (p = parse_part(argv[optind + 2])) < 0) {
+            usage(argv0);
+            return 1;
+        }
+
+        if((part = flash_map_partition(p, &len))) {
+            printf("-----------------------------\n"
+                   "Partition: %s\n"
+                   "Size: %d bytes\n"
+                   "-----------------------------\n", part_names[p], len);
+            fprint_hex(stdout, part, len, squeeze);
+            rv = 0;
+        }
+        else {
+            rv = -1;
+        }
+    }
+    else if(!strcmp(cmd, "blocks")) {
+        if(argc - optind < 3 || (p = parse_part(argv[optind + 2])) < 0) {
+            usage(argv0);
+            return 1;
+        }
+
+        rv = show_blocks(p, argc - optind - 3, argv + optind + 3);
+    }
+    else if(!strcmp(cmd, "write")) {
+        if(argc - optind < 5 || (p = parse_part(argv[optind + 2])) < 0) {
+            usage(argv0);
+            return 1;
+        }
+
+        rv = write_block(p, argv[optind + 3], argv[optind + 4]);
+        modified = 1;
+    }
+    else if(!strcmp(cmd, "kill")) {
+        if(argc - optind < 4 || (p = parse_part(argv[optind + 2])) < 0) {
+            usage(argv0);
+            return 1;
+        }
+
+        if(parse_id(argv[optind + 3], &id))
+            return 1;
+
+        rv = flash_kill_block(p, id);
+        flog_drain(stdout, 0);
+        if(rv >= 0)
+            printf("Killed %d cop%s\n", rv, rv == 1 ? "y" : "ies");
+        modified = 1;
+    }
+    else if(!strcmp(cmd, "erase-keys")) {
+        rv = erase_pso_keys();
+        flog_drain(stdout, 0);
+        if(rv >= 0)
+            printf("Removed %d block(s)\n", rv);
+        modified = 1;
+    }
+    else if(!strcmp(cmd, "scrub")) {
+        rv = scrub(argc - optind - 2, argv + optind + 2);
+        modified = 1;
+    }
+    else if(!strcmp(cmd, "erase")) {
+        rv = erase_flashrom();
+        modified = 1;
+    }
+    else if(!strcmp(cmd, "restore")) {
+        if(argc - optind < 3) {
+            usage(argv0);
+            return 1;
+        }
+
+        rv = restore(argv[optind + 2]);
+        modified = 1;
+    }
+    else if(!strcmp(cmd, "batch")) {
+        if(argc - optind < 3) {
+            usage(argv0);
+            return 1;
+        }
+
+        rv = run_batch(argv[optind + 2]);
+        modified = 1;
+    }
+    else if(!strcmp(cmd, "pack") || !strcmp(cmd, "unpack")) {
+        if(argc - optind < 3) {
+            usage(argv0);
+            return 1;
+        }
+
+        rv = flash_image_save_as(argv[optind + 2], cmd[0] == 'p');
+    }
+    else {
+        usage(argv0);
+        return 1;
+    }
+
+    /* Anything the engine logged that hasn't been shown yet. */
+    flog_drain(stdout, 0);
+
+    if(stats)
+        show_stats();
+
+    flash_get_stats(&st);
+
+    if(trace && trace_save(trace))
+        printf("Couldn't write trace to %s\n", trace);
+
+    if(ledger && (st.op[FLASH_OP_WRITE].count || st.op[FLASH_OP_ERASE].count))
+        wear_append(ledger, &st);
+
+    if(rv < 0)
+        return 1;
+
+    if(modified && flash_image_save(out ? out : img))
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,205 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <stdint.h>
+
+#include <kos/thread.h>
+#include <kos/sem.h>
+#include <kos/mutex.h>
+#include <dc/vblank.h>
+#include <dc/maple.h>
+#include <dc/maple/controller.h>
+
+#include "input.h"
+
+/* Controller input is sampled by its own thread, which turns button changes
+   into events in a queue for the menus to wait on. Maple only updates the
+   controller state once a frame, so the thread waits for each vblank (which
+   comes at whatever rate the display runs at) and samples once per frame. The
+   debounce and chord timings below are counted in frames. */
+
+/* Don't hang if vblanks stop coming for some reason. */
+#define VBLANK_TIMEOUT  100
+
+/* A change has to be seen this many samples in a row to count. */
+#define DEBOUNCE        2
+
+/* Presses this many samples after the first are part of the same chord. */
+#define CHORD_WINDOW    4
+
+#define QUEUE_LEN       16
+
+static input_event_t queue[QUEUE_LEN];
+static int q_head, q_tail;
+static mutex_t q_lock;
+static semaphore_t q_sem;
+
+static kthread_t *thd;
+static volatile int running;
+static semaphore_t vbl_sem;
+static int vbl_handle = -1;
+
+static void vblank(uint32 code) {
+    (void)code;
+    sem_signal(&vbl_sem);
+}
+
+static void push(int type, uint32_t buttons, uint32_t held) {
+    int next;
+
+    mutex_lock(&q_lock);
+    next = (q_tail + 1) % QUEUE_LEN;
+
+    /* If nobody's listening, don't let old events pile up. */
+    if(next == q_head) {
+        mutex_unlock(&q_lock);
+        return;
+    }
+
+    queue[q_tail].type = type;
+    queue[q_tail].buttons = buttons;
+    queue[q_tail].held = held;
+    q_tail = next;
+    mutex_unlock(&q_lock);
+
+    sem_signal(&q_sem);
+}
+
+static uint32_t sample(void) {
+    maple_device_t *dev;
+    cont_state_t *state;
+
+    if(!(dev = maple_enum_type(0, MAPLE_FUNC_CONTROLLER)))
+        return 0;
+
+    /* The device might not have reported its status yet. */
+    if(!(state = (cont_state_t *)maple_dev_status(dev)))
+        return 0;
+
+    return state->buttons;
+}
+
+static void *input_thd(void *d) {
+    uint32_t cur, held = 0, cand = 0, chord = 0;
+    int stable = 0, chord_left = 0;
+
+    (void)d;
+
+    while(running) {
+        sem_wait_timed(&vbl_sem, VBLANK_TIMEOUT);
+        cur = sample();
+
+        /* Debounce: wait until the state settles before acting on it. */
+        if(cur != cand) {
+            cand = cur;
+            stable = 0;
+        }
+
+        if(++stable >= DEBOUNCE && cand != held) {
+            if(held & ~cand) {
+                /* Something got let go of before the chord window closed, so
+                   send the chord now to keep things in order. */
+                if(chord) {
+                    push(INPUT_PRESS, chord, held);
+                    chord = 0;
+                }
+
+                push(INPUT_RELEASE, held & ~cand, cand);
+            }
+
+            /* Start (or add to) a chord with anything newly pressed. */
+            if(cand & ~held) {
+                if(!chord)
+                    chord_left = CHORD_WINDOW;
+
+                chord |= cand & ~held;
+            }
+
+            held = cand;
+        }
+
+        if(chord && --chord_left <= 0) {
+            push(INPUT_PRESS, chord, held);
+            chord = 0;
+        }
+    }
+
+    return NULL;
+}
+
+int input_init(void) {
+    q_head = q_tail = 0;
+    mutex_init(&q_lock, MUTEX_TYPE_NORMAL);
+    sem_init(&q_sem, 0);
+    sem_init(&vbl_sem, 0);
+
+    if((vbl_handle = vblank_handler_add(vblank)) < 0)
+        return -1;
+
+    running = 1;
+
+    if(!(thd = thd_create(0, input_thd, NULL))) {
+        running = 0;
+        vblank_handler_remove(vbl_handle);
+        vbl_handle = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+void input_shutdown(void) {
+    if(!thd)
+        return;
+
+    running = 0;
+    thd_join(thd, NULL);
+    thd = NULL;
+
+    vblank_handler_remove(vbl_handle);
+    vbl_handle = -1;
+}
+
+static void pop(input_event_t *ev) {
+    mutex_lock(&q_lock);
+    *ev = queue[q_head];
+    q_head = (q_head + 1) % QUEUE_LEN;
+    mutex_unlock(&q_lock);
+}
+
+/* Block until the next event comes in. */
+void input_wait(input_event_t *ev) {
+    sem_wait(&q_sem);
+    pop(ev);
+}
+
+/* Grab the next event if there is one. Returns 0 if one was waiting. */
+int input_poll(input_event_t *ev) {
+    if(sem_trywait(&q_sem))
+        return -1;
+
+    pop(ev);
+    return 0;
+}
+
+/* Throw away anything that came in before now. */
+void input_flush(void) {
+    input_event_t ev;
+
+    while(!input_poll(&ev)) ;
+}
@@ -0,0 +1,40 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdint.h>
+
+#define INPUT_PRESS     1
+#define INPUT_RELEASE   2
+
+/* A press event covers every button that went down within a few frames of the
+   first one, so chords like A + B come through as a single event. */
+typedef struct input_event {
+    int type;
+    uint32_t buttons;               /* Buttons pressed or released */
+    uint32_t held;                  /* Everything held after the event */
+} input_event_t;
+
+int input_init(void);
+void input_shutdown(void);
+void input_wait(input_event_t *ev);
+int input_poll(input_event_t *ev);
+void input_flush(void);
+
+#endif /* !INPUT_H */
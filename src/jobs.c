@@ -0,0 +1,170 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <arch/timer.h>
+#include <kos/thread.h>
+#include <kos/sem.h>
+#include <kos/mutex.h>
+
+#include "flashrom.h"
+#include "jobs.h"
+
+/* Flash operations get run on a worker thread of their own, so the UI can keep
+   drawing while they go. Jobs run in the order they're submitted, which makes a
+   chain (backup, then scrub, then verify) just a few submits in a row. If any
+   job in the chain fails, the rest of the queue is thrown out. */
+
+#define QUEUE_LEN   8
+
+typedef struct job {
+    const char *name;
+    job_fn_t fn;
+    void *arg;
+    uint32_t total;
+} job_t;
+
+static job_t queue[QUEUE_LEN];
+static int q_head, q_tail;
+static mutex_t q_lock;
+static semaphore_t q_sem;
+
+static job_status_t status;
+static kthread_t *thd;
+
+static void observe(int op, int offset, int len) {
+    (void)offset;
+
+    switch(op) {
+        case FLASH_OP_READ:
+            status.bytes_read += len;
+            break;
+
+        case FLASH_OP_WRITE:
+            status.bytes_programmed += len;
+            break;
+
+        case FLASH_OP_ERASE:
+            status.bytes_erased += len;
+            break;
+    }
+}
+
+static void *worker_thd(void *d) {
+    job_t job;
+
+    (void)d;
+
+    for(;;) {
+        sem_wait(&q_sem);
+
+        mutex_lock(&q_lock);
+        job = queue[q_head];
+        q_head = (q_head + 1) % QUEUE_LEN;
+        mutex_unlock(&q_lock);
+
+        status.name = job.name;
+        status.total = job.total;
+        status.bytes_read = 0;
+        status.bytes_erased = 0;
+        status.bytes_programmed = 0;
+        status.start_ms = (uint32_t)timer_ms_gettime64();
+        status.state = JOB_RUNNING;
+
+        flash_set_observer(observe);
+        status.result = job.fn(job.arg);
+        flash_set_observer(NULL);
+
+        mutex_lock(&q_lock);
+
+        if(status.result < 0) {
+            status.state = JOB_FAILED;
+
+            /* Cancel the rest of the chain. */
+            while(!sem_trywait(&q_sem)) {
+                q_head = (q_head + 1) % QUEUE_LEN;
+                --status.pending;
+            }
+        }
+        else {
+            status.state = JOB_DONE;
+        }
+
+        --status.pending;
+        mutex_unlock(&q_lock);
+    }
+
+    return NULL;
+}
+
+int jobs_init(void) {
+    q_head = q_tail = 0;
+    mutex_init(&q_lock, MUTEX_TYPE_NORMAL);
+    sem_init(&q_sem, 0);
+    status.state = JOB_IDLE;
+
+    if(!(thd = thd_create(1, worker_thd, NULL)))
+        return -1;
+
+    return 0;
+}
+
+int job_submit(const char *name, job_fn_t fn, void *arg, uint32_t total) {
+    int next;
+
+    mutex_lock(&q_lock);
+    next = (q_tail + 1) % QUEUE_LEN;
+
+    if(next == q_head) {
+        mutex_unlock(&q_lock);
+        return -1;
+    }
+
+    queue[q_tail].name = name;
+    queue[q_tail].fn = fn;
+    queue[q_tail].arg = arg;
+    queue[q_tail].total = total;
+    q_tail = next;
+    ++status.pending;
+    mutex_unlock(&q_lock);
+
+    sem_signal(&q_sem);
+    return 0;
+}
+
+const job_status_t *jobs_status(void) {
+    return &status;
+}
+
+/* Wait for everything queued to finish, calling tick a few times a second so
+   the caller can show how things are going. Returns the result of the last job
+   that ran, which will be the failing one if anything went wrong. */
+int jobs_wait(void (*tick)(const job_status_t *st, void *d), void *d) {
+    while(status.pending) {
+        if(tick)
+            tick(&status, d);
+
+        thd_sleep(100);
+    }
+
+    if(tick)
+        tick(&status, d);
+
+    return status.result;
+}
@@ -0,0 +1,52 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdint.h>
+
+#define JOB_IDLE        0
+#define JOB_RUNNING     1
+#define JOB_DONE        2
+#define JOB_FAILED      3
+
+/* A job returns a negative value on failure, which cancels anything queued up
+   after it. */
+typedef int (*job_fn_t)(void *arg);
+
+/* Written only by the worker thread and read by whoever wants to show it, so
+   there's no lock. Every field is a single aligned word, so a reader might see
+   a mix of old and new values, but never a torn one. */
+typedef struct job_status {
+    volatile int state;
+    volatile int result;
+    const char * volatile name;
+    volatile uint32_t total;            /* Estimated bytes of work */
+    volatile uint32_t bytes_read;
+    volatile uint32_t bytes_erased;
+    volatile uint32_t bytes_programmed;
+    volatile uint32_t start_ms;
+    volatile uint32_t pending;          /* Jobs queued or running */
+} job_status_t;
+
+int jobs_init(void);
+int job_submit(const char *name, job_fn_t fn, void *arg, uint32_t total);
+const job_status_t *jobs_status(void);
+int jobs_wait(void (*tick)(const job_status_t *st, void *d), void *d);
+
+#endif /* !JOBS_H */
@@ -0,0 +1,242 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "flashrom.h"
+#include "partidx.h"
+
+static int key_cmp(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Check the CRC stored in a block against its contents. */
+int part_block_ok(const uint8_t *blk) {
+    return flash_block_crc(blk) == (blk[FLASHROM_OFFSET_CRC] |
+                                    (blk[FLASHROM_OFFSET_CRC + 1] << 8));
+}
+
+/* Set up a view of a partition that has been read or mapped at buf. The blocks
+   are allocated in order, so the used ones run up to the first free bit in the
+   bitmap. */
+int part_view_init(part_view_t *v, const uint8_t *buf, int len) {
+    const uint8_t *bitmap;
+    int n;
+
+    if(len < 128 || (len & 63) || memcmp(buf, "KATANA_FLASH____", 16))
+        return -1;
+
+    v->buf = buf;
+    v->len = len;
+    v->bmlen = PART_BITMAP_LEN(len);
+    v->nblks = PART_BLOCKS(len);
+    bitmap = buf + len - v->bmlen;
+
+    if(v->nblks > PART_MAX_BLOCKS)
+        return -1;
+
+    for(n = 0; n < v->nblks && !(bitmap[n >> 3] & (0x80 >> (n & 7))); ++n) ;
+
+    v->used = n;
+    return 0;
+}
+
+/* Whether the bitmap says a slot is in use. */
+int part_view_allocated(const part_view_t *v, int slot) {
+    const uint8_t *bitmap = v->buf + v->len - v->bmlen;
+
+    if(slot < 0 || slot >= v->nblks)
+        return 0;
+
+    return !(bitmap[slot >> 3] & (0x80 >> (slot & 7)));
+}
+
+/* Find the latest good copy of a block by working back from the end, without
+   needing an index. If bad isn't NULL, it gets the number of copies with a bad
+   CRC that were newer than the one found. */
+const uint8_t *part_view_latest(const part_view_t *v, uint16_t id, int *bad) {
+    const uint8_t *blk;
+    int s, nbad = 0;
+
+    for(s = v->used - 1; s >= 0; --s) {
+        blk = PART_VIEW_SLOT(v, s);
+
+        if(blk[0] != (uint8_t)id || blk[1] != (uint8_t)(id >> 8))
+            continue;
+
+        if(part_block_ok(blk))
+            break;
+
+        ++nbad;
+    }
+
+    if(bad)
+        *bad = nbad;
+
+    return s >= 0 ? PART_VIEW_SLOT(v, s) : NULL;
+}
+
+void part_iter_init(part_iter_t *it, const part_view_t *v, int latest) {
+    uint32_t keys[PART_MAX_BLOCKS];
+    const uint8_t *blk;
+    int i, j, e, s, n = v->used;
+
+    it->v = v;
+    it->slot = 0;
+    it->latest = latest;
+
+    if(!latest)
+        return;
+
+    /* Sort the slots by block number, keeping the order they were written in
+       for each block. The last good copy in each run is the one to keep. */
+    memset(it->keep, 0, sizeof(it->keep));
+
+    for(i = 0; i < n; ++i) {
+        blk = PART_VIEW_SLOT(v, i);
+        keys[i] = ((uint32_t)(blk[0] | (blk[1] << 8)) << 16) | i;
+    }
+
+    qsort(keys, n, sizeof(uint32_t), key_cmp);
+
+    for(i = 0; i < n; i = e) {
+        for(e = i + 1; e < n && (keys[e] >> 16) == (keys[i] >> 16); ++e) ;
+
+        for(j = e - 1; j >= i; --j) {
+            s = keys[j] & 0xFFFF;
+
+            if(part_block_ok(PART_VIEW_SLOT(v, s))) {
+                it->keep[s >> 3] |= 0x80 >> (s & 7);
+                break;
+            }
+        }
+    }
+}
+
+/* Get the next block, or NULL at the end. When only the latest copies are
+   wanted, a block is skipped if it has a bad CRC or if there's a good copy of
+   the same block after it. */
+const uint8_t *part_iter_next(part_iter_t *it) {
+    const part_view_t *v = it->v;
+    int s;
+
+    while(it->slot < v->used) {
+        s = it->slot++;
+
+        if(!it->latest || (it->keep[s >> 3] & (0x80 >> (s & 7))))
+            return PART_VIEW_SLOT(v, s);
+    }
+
+    return NULL;
+}
+
+/* Check the CRC of every allocated block in a partition, without bothering to
+   index them. Returns the number of bad blocks, or -1 if buf doesn't look like
+   a partition. */
+int part_validate(const uint8_t *buf, int len) {
+    part_view_t v;
+    part_iter_t it;
+    const uint8_t *blk;
+    int bad = 0;
+
+    if(part_view_init(&v, buf, len))
+        return -1;
+
+    part_iter_init(&it, &v, 0);
+
+    while((blk = part_iter_next(&it))) {
+        if(!part_block_ok(blk))
+            ++bad;
+    }
+
+    return bad;
+}
+
+/* Parse the allocated blocks of a partition that has been read into buf. This
+   is one pass over the blocks plus a sort, after which looking up any block
+   number is a binary search. */
+int part_index_build(part_index_t *idx, const uint8_t *buf, int len) {
+    uint32_t keys[PART_MAX_BLOCKS];
+    const uint8_t *bitmap, *blk;
+    int i, j, n;
+    part_entry_t *e;
+
+    if(len < 128 || (len & 63) || memcmp(buf, "KATANA_FLASH____", 16))
+        return -1;
+
+    idx->len = len;
+    idx->bmlen = PART_BITMAP_LEN(len);
+    idx->nblks = PART_BLOCKS(len);
+    idx->count = 0;
+    bitmap = buf + len - idx->bmlen;
+
+    if(idx->nblks > PART_MAX_BLOCKS)
+        return -1;
+
+    /* Blocks are allocated in order, so the first free one ends the list. */
+    for(n = 0; n < idx->nblks; ++n) {
+        if(bitmap[n >> 3] & (0x80 >> (n & 7)))
+            break;
+
+        blk = buf + PART_SLOT_OFFSET(n);
+        keys[n] = ((uint32_t)(blk[0] | (blk[1] << 8)) << 16) | n;
+    }
+
+    idx->used = n;
+    qsort(keys, n, sizeof(uint32_t), key_cmp);
+
+    /* Each run of keys is one block number, in the order they were written. */
+    for(i = 0; i < n; i = j) {
+        e = &idx->ent[idx->count++];
+        e->id = (uint16_t)(keys[i] >> 16);
+        e->copies = 0;
+        e->bad = 0;
+        e->slot = -1;
+
+        for(j = i; j < n && (keys[j] >> 16) == e->id; ++j) {
+            blk = buf + PART_SLOT_OFFSET(keys[j] & 0xFFFF);
+            ++e->copies;
+
+            if(!part_block_ok(blk))
+                ++e->bad;
+            else
+                e->slot = (int16_t)(keys[j] & 0xFFFF);
+        }
+    }
+
+    return 0;
+}
+
+const part_entry_t *part_index_find(const part_index_t *idx, uint16_t id) {
+    int lo = 0, hi = idx->count - 1, mid;
+
+    while(lo <= hi) {
+        mid = (lo + hi) >> 1;
+
+        if(idx->ent[mid].id == id)
+            return &idx->ent[mid];
+        else if(idx->ent[mid].id < id)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return NULL;
+}
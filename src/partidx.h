@@ -0,0 +1,91 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARTIDX_H
+#define PARTIDX_H
+
+#include <stdint.h>
+
+/* The biggest partition (64KB) has 1021 usable blocks. */
+#define PART_MAX_BLOCKS 1024
+
+/* Byte offset within the partition of a given block slot. Slot 0 is the first
+   block after the header. */
+#define PART_SLOT_OFFSET(s) (((s) + 1) << 6)
+
+/* The bitmap at the end of a partition has one bit per block, and takes up a
+   whole number of blocks. Thus, take the number of blocks in the partition,
+   round that up to a multiple of 512 (the number of bits in a block) and divide
+   by 8 to get the length in bytes. Everything between the header block and the
+   bitmap is usable. */
+#define PART_BITMAP_LEN(len)    (((((len) >> 6) + 511) & ~511) >> 3)
+#define PART_BLOCKS(len)        (((len) >> 6) - 1 - (PART_BITMAP_LEN(len) >> 6))
+
+/* One of these for each distinct logical block number in a partition. */
+typedef struct part_entry {
+    uint16_t id;
+    uint16_t copies;                /* All copies of this block */
+    uint16_t bad;                   /* Copies with a bad CRC */
+    int16_t slot;                   /* Latest good copy, or -1 if none */
+} part_entry_t;
+
+/* Parsed view of a partition's allocated blocks, sorted by block number. */
+typedef struct part_index {
+    int len;                        /* Partition length */
+    int bmlen;                      /* Bitmap length, in bytes */
+    int nblks;                      /* Usable block slots */
+    int used;                       /* Allocated block slots */
+    int count;                      /* Number of entries */
+    part_entry_t ent[PART_MAX_BLOCKS];
+} part_index_t;
+
+/* Read-only view of a partition, pointing straight at wherever it lives (the
+   mapped flashrom, an image in memory, or a cached copy). Nothing here copies
+   or allocates anything. */
+typedef struct part_view {
+    const uint8_t *buf;
+    int len;                        /* Partition length */
+    int bmlen;                      /* Bitmap length, in bytes */
+    int nblks;                      /* Usable block slots */
+    int used;                       /* Allocated block slots */
+} part_view_t;
+
+#define PART_VIEW_SLOT(v, s)    ((v)->buf + PART_SLOT_OFFSET(s))
+
+/* Walks over the allocated blocks of a view in the order they were written,
+   optionally skipping everything but the latest good copy of each block. For
+   that, part_iter_init works out which slots to keep up front, with a sort
+   like part_index_build does. */
+typedef struct part_iter {
+    const part_view_t *v;
+    int slot;
+    int latest;
+    uint8_t keep[PART_MAX_BLOCKS / 8];
+} part_iter_t;
+
+int part_view_init(part_view_t *v, const uint8_t *buf, int len);
+int part_view_allocated(const part_view_t *v, int slot);
+const uint8_t *part_view_latest(const part_view_t *v, uint16_t id, int *bad);
+void part_iter_init(part_iter_t *it, const part_view_t *v, int latest);
+const uint8_t *part_iter_next(part_iter_t *it);
+
+int part_block_ok(const uint8_t *blk);
+int part_validate(const uint8_t *buf, int len);
+int part_index_build(part_index_t *idx, const uint8_t *buf, int len);
+const part_entry_t *part_index_find(const part_index_t *idx, uint16_t id);
+
+#endif /* !PARTIDX_H */
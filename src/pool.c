@@ -0,0 +1,153 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "pool.h"
+
+/* A very small work-stealing thread pool. The items are split evenly between
+   the threads up front. Each thread works from the front of its own range, and
+   once that runs dry it steals the back half of somebody else's. A range is
+   packed into a single 64-bit word (start in the low half, end in the high
+   half), so both taking and stealing are just a compare-and-swap. Nothing gets
+   added once we've started, so when every range is empty we're done. */
+
+typedef struct worker {
+    uint64_t range;
+    int id;
+    struct pool *pool;
+    pthread_t thd;
+} __attribute__((aligned(64))) worker_t;
+
+typedef struct pool {
+    worker_t *w;
+    int nthreads;
+    pool_fn_t fn;
+    void *arg;
+} pool_t;
+
+#define RANGE(lo, hi)   (((uint64_t)(hi) << 32) | (uint32_t)(lo))
+#define RANGE_LO(r)     ((int)(uint32_t)(r))
+#define RANGE_HI(r)     ((int)((r) >> 32))
+
+static int take(worker_t *w) {
+    uint64_t r = __atomic_load_n(&w->range, __ATOMIC_ACQUIRE);
+
+    while(RANGE_LO(r) < RANGE_HI(r)) {
+        if(__atomic_compare_exchange_n(&w->range, &r,
+                                       RANGE(RANGE_LO(r) + 1, RANGE_HI(r)), 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return RANGE_LO(r);
+    }
+
+    return -1;
+}
+
+static int steal(worker_t *self) {
+    pool_t *p = self->pool;
+    worker_t *v;
+    uint64_t r;
+    int i, lo, hi, mid;
+
+    for(i = 1; i < p->nthreads; ++i) {
+        v = &p->w[(self->id + i) % p->nthreads];
+        r = __atomic_load_n(&v->range, __ATOMIC_ACQUIRE);
+
+        while((lo = RANGE_LO(r)) < (hi = RANGE_HI(r))) {
+            mid = lo + (hi - lo) / 2;
+
+            if(__atomic_compare_exchange_n(&v->range, &r, RANGE(lo, mid), 0,
+                                           __ATOMIC_ACQ_REL,
+                                           __ATOMIC_ACQUIRE)) {
+                /* Our own range is empty, so nobody will be racing us for it
+                   except thieves, who'll just see the new value. */
+                __atomic_store_n(&self->range, RANGE(mid, hi),
+                                 __ATOMIC_RELEASE);
+                return 0;
+            }
+        }
+    }
+
+    return -1;
+}
+
+static void *worker_thd(void *d) {
+    worker_t *w = (worker_t *)d;
+    pool_t *p = w->pool;
+    int i;
+
+    for(;;) {
+        while((i = take(w)) >= 0) {
+            p->fn(i, w->id, p->arg);
+        }
+
+        if(steal(w))
+            break;
+    }
+
+    return NULL;
+}
+
+int pool_default_threads(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (int)n : 1;
+}
+
+int pool_run(int nthreads, int n, pool_fn_t fn, void *arg) {
+    pool_t p;
+    int i, started;
+
+    if(nthreads < 1)
+        nthreads = 1;
+
+    if(!(p.w = (worker_t *)aligned_alloc(64, sizeof(worker_t) * nthreads))) {
+        printf("Couldn't allocate thread pool\n");
+        return -1;
+    }
+
+    p.nthreads = nthreads;
+    p.fn = fn;
+    p.arg = arg;
+
+    for(i = 0; i < nthreads; ++i) {
+        p.w[i].range = RANGE((int64_t)n * i / nthreads,
+                             (int64_t)n * (i + 1) / nthreads);
+        p.w[i].id = i;
+        p.w[i].pool = &p;
+    }
+
+    /* The calling thread does its share of the work as worker 0. */
+    for(started = 1; started < nthreads; ++started) {
+        if(pthread_create(&p.w[started].thd, NULL, worker_thd, &p.w[started]))
+            break;
+    }
+
+    worker_thd(&p.w[0]);
+
+    /* If some threads couldn't be started, their work just gets stolen. */
+    for(i = 1; i < started; ++i) {
+        pthread_join(p.w[i].thd, NULL);
+    }
+
+    free(p.w);
+    return 0;
+}
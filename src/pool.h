@@ -0,0 +1,27 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef POOL_H
+#define POOL_H
+
+/* Run fn(i, arg) for every i in [0, n) across nthreads threads (host only). */
+typedef void (*pool_fn_t)(int i, int thread, void *arg);
+
+int pool_run(int nthreads, int n, pool_fn_t fn, void *arg);
+int pool_default_threads(void);
+
+#endif /* !POOL_H */
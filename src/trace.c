@@ -0,0 +1,162 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#ifdef _arch_dreamcast
+#include <arch/irq.h>
+#include <arch/timer.h>
+#include <kos/thread.h>
+#else
+#include <time.h>
+#endif
+
+#include "trace.h"
+
+typedef struct trace_event {
+    const char *name;
+    uint64_t start;
+    uint32_t dur;
+    uint32_t tid;
+} trace_event_t;
+
+static trace_event_t events[TRACE_MAX_EVENTS];
+static uint32_t count, dropped;
+static volatile int enabled;
+
+#ifdef _arch_dreamcast
+static uint64_t now_us(void) {
+    return timer_us_gettime64();
+}
+
+static uint32_t thread_id(void) {
+    return (uint32_t)thd_get_current()->tid;
+}
+
+/* One CPU, so masking interrupts is enough to keep anyone else out. */
+static trace_event_t *next_event(void) {
+    int irqs = irq_disable();
+    trace_event_t *e = &events[count % TRACE_MAX_EVENTS];
+
+    if(++count > TRACE_MAX_EVENTS)
+        ++dropped;
+
+    irq_restore(irqs);
+    return e;
+}
+#else
+static uint64_t now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Threads just get numbered in the order they first finish a zone. */
+static uint32_t thread_id(void) {
+    static uint32_t last;
+    static __thread uint32_t id;
+
+    if(!id)
+        id = __atomic_add_fetch(&last, 1, __ATOMIC_RELAXED);
+
+    return id;
+}
+
+static trace_event_t *next_event(void) {
+    uint32_t i = __atomic_fetch_add(&count, 1, __ATOMIC_RELAXED);
+
+    if(i >= TRACE_MAX_EVENTS)
+        __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+
+    return &events[i % TRACE_MAX_EVENTS];
+}
+#endif
+
+void trace_enable(int on) {
+    enabled = on;
+}
+
+/* Throw away everything recorded so far. */
+void trace_reset(void) {
+    count = 0;
+    dropped = 0;
+}
+
+trace_zone_t trace_begin(const char *name) {
+    trace_zone_t z;
+
+    z.name = enabled ? name : NULL;
+    z.start = enabled ? now_us() : 0;
+    return z;
+}
+
+void trace_end(trace_zone_t *z) {
+    trace_event_t *e;
+    uint64_t t;
+
+    if(!z->name)
+        return;
+
+    t = now_us();
+    e = next_event();
+    e->name = z->name;
+    e->start = z->start;
+    e->dur = (uint32_t)(t - z->start);
+    e->tid = thread_id();
+}
+
+/* Write out what's been recorded so far as Chrome trace event JSON, oldest
+   first. Every zone is a complete ("X") event, and the viewer works out the
+   nesting from the times. This shouldn't be called while anything else could be
+   finishing a zone. */
+int trace_write(FILE *fp) {
+    const trace_event_t *e;
+    uint32_t i, n = count < TRACE_MAX_EVENTS ? count : TRACE_MAX_EVENTS;
+    uint32_t first = count - n;
+
+    fprintf(fp, "{\"traceEvents\":[");
+
+    for(i = 0; i < n; ++i) {
+        e = &events[(first + i) % TRACE_MAX_EVENTS];
+        fprintf(fp, "%s\n{\"name\":\"%s\",\"cat\":\"flash\",\"ph\":\"X\","
+                "\"pid\":1,\"tid\":%" PRIu32 ",\"ts\":%" PRIu64 ",\"dur\":%"
+                PRIu32 "}", i ? "," : "", e->name, e->tid, e->start, e->dur);
+    }
+
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":%"
+            PRIu32 "}}\n", dropped);
+
+    return ferror(fp) ? -1 : 0;
+}
+
+int trace_save(const char *fn) {
+    FILE *fp;
+    int rv;
+
+    if(!(fp = fopen(fn, "w")))
+        return -1;
+
+    rv = trace_write(fp);
+
+    if(fclose(fp))
+        return -1;
+
+    return rv;
+}
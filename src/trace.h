@@ -0,0 +1,56 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Timing of whole stretches of code, for finding out where the time goes.
+   TRACE_ZONE(name) at the top of a block times everything from there to the
+   end of the block, however it's left. Each finished zone goes into a ring of
+   TRACE_MAX_EVENTS, so once it's full the oldest are overwritten (and counted
+   as dropped) to keep the latest ones.
+   The buffer can be written out as Chrome trace event JSON, which opens in
+   chrome://tracing or Perfetto as a timeline. Nothing is recorded until
+   trace_enable(1) is called, and a zone costs one check of a flag until then.
+   Names have to stay around for good, which string constants do. */
+
+#define TRACE_MAX_EVENTS    4096
+
+typedef struct trace_zone {
+    const char *name;
+    uint64_t start;
+} trace_zone_t;
+
+trace_zone_t trace_begin(const char *name);
+void trace_end(trace_zone_t *z);
+
+#define TRACE_CAT2(a, b)    a##b
+#define TRACE_CAT(a, b)     TRACE_CAT2(a, b)
+
+#define TRACE_ZONE(name) \
+    trace_zone_t TRACE_CAT(trace_zone_, __LINE__) \
+        __attribute__((cleanup(trace_end), unused)) = trace_begin(name)
+
+void trace_enable(int on);
+void trace_reset(void);
+int trace_write(FILE *fp);
+int trace_save(const char *fn);
+
+#endif /* !TRACE_H */
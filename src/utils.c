@@ -16,75 +16,139 @@
 */
 
 #include <stdio.h>
+#include <string.h>
 #include <stdint.h>
 
-/* Only for printing out to dcload, for debugging purposes... */
-void fprint_buf(FILE *fp, const unsigned char *pkt, int len) {
-    const unsigned char *pos = pkt, *row = pkt;
-    int line = 0, type = 0;
+#include "utils.h"
 
-    /* Print the data both in hex and ASCII. */
-    while(pos < pkt + len) {
-        if(line == 0 && type == 0) {
-            fprintf(fp, "%04X ", (uint16_t)(pos - pkt));
-        }
+static const char hexdigits[16] = {
+    '0', '1', '2', '3', '4', '5', '6', '7',
+    '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'
+};
 
-        if(type == 0) {
-            fprintf(fp, "%02X ", *pos);
-        }
-        else {
-            if(*pos >= 0x20 && *pos < 0x7F) {
-                fprintf(fp, "%c", *pos);
-            }
-            else {
-                fprintf(fp, ".");
-            }
-        }
+/* Offsets are always at least 4 digits, but get longer if they need to. */
+static int format_off(char *buf, uint32_t off) {
+    char *o = buf;
+    int i;
 
-        ++line;
-        ++pos;
-
-        if(line == 16) {
-            if(type == 0) {
-                fprintf(fp, "\t");
-                pos = row;
-                type = 1;
-                line = 0;
-            }
-            else {
-                fprintf(fp, "\n");
-                line = 0;
-                row = pos;
-                type = 0;
-            }
-        }
+    for(i = 28; i > 12 && !(off >> i); i -= 4) ;
+
+    for(; i >= 0; i -= 4) {
+        *o++ = hexdigits[(off >> i) & 0x0F];
     }
 
-    /* Finish off the last row's ASCII if needed. */
-    if(len & 0x1F) {
-        /* Put spaces in place of the missing hex stuff. */
-        while(line != 16) {
-            fprintf(fp, "   ");
-            ++line;
-        }
+    return (int)(o - buf);
+}
+
+/* Build one row of a hex dump into buf, returning its length. The row looks
+   like "OOOO XX XX ... XX \tAAAAAAAAAAAAAAAA\n", with spaces in place of the
+   hex for any bytes past the end of a short row. */
+static int format_row(char *buf, uint32_t off, const unsigned char *row,
+                      int cnt) {
+    char *o = buf + format_off(buf, off);
+    int i;
+
+    *o++ = ' ';
+
+    for(i = 0; i < cnt; ++i) {
+        *o++ = hexdigits[row[i] >> 4];
+        *o++ = hexdigits[row[i] & 0x0F];
+        *o++ = ' ';
+    }
+
+    for(; i < 16; ++i) {
+        *o++ = ' ';
+        *o++ = ' ';
+        *o++ = ' ';
+    }
+
+    *o++ = '\t';
+
+    for(i = 0; i < cnt; ++i) {
+        if(row[i] >= 0x20 && row[i] < 0x7F)
+            *o++ = (char)row[i];
+        else
+            *o++ = '.';
+    }
+
+    *o++ = '\n';
+    return (int)(o - buf);
+}
+
+/* Print a buffer in hex and ASCII, 16 bytes to a line. Each line is built up
+   in a local buffer and written out in one go. If squeeze is set, any run of
+   lines identical to the one before is printed as a single "*", just like
+   hexdump does (mostly useful for the big runs of 0xFF in the flashrom). */
+void fprint_hex(FILE *fp, const unsigned char *pkt, int len, int squeeze) {
+    char line[96];
+    int pos, cnt, n, skipping = 0;
 
-        pos = row;
-        fprintf(fp, "\t");
+    for(pos = 0; pos < len; pos += 16) {
+        cnt = len - pos < 16 ? len - pos : 16;
 
-        /* Here comes the ASCII. */
-        while(pos < pkt + len) {
-            if(*pos >= 0x20 && *pos < 0x7F) {
-                fprintf(fp, "%c", *pos);
-            }
-            else {
-                fprintf(fp, ".");
-            }
+        if(squeeze && pos && cnt == 16 && !memcmp(pkt + pos, pkt + pos - 16, 16)) {
+            if(!skipping)
+                fwrite("*\n", 1, 2, fp);
 
-            ++pos;
+            skipping = 1;
+            continue;
         }
 
-        fprintf(fp, "\n");
+        skipping = 0;
+        n = format_row(line, (uint32_t)pos, pkt + pos, cnt);
+        fwrite(line, 1, n, fp);
+    }
+
+    /* Like hexdump, show where the data ended if the tail got squeezed. */
+    if(skipping) {
+        n = format_off(line, (uint32_t)len);
+        line[n++] = '\n';
+        fwrite(line, 1, n, fp);
     }
 
     fflush(fp);
 }
+
+/* Only for printing out to dcload, for debugging purposes... */
+void fprint_buf(FILE *fp, const unsigned char *pkt, int len) {
+    fprint_hex(fp, pkt, len, 0);
+}
+
+/* Simple shell-style wildcard matching, supporting only * and ?. */
+int glob_match(const char *pat, const char *str) {
+    const char *star = NULL, *retry = NULL;
+
+    while(*str) {
+        if(*pat == '*') {
+            star = ++pat;
+            retry = str;
+        }
+        else if(*pat == '?' || *pat == *str) {
+            ++pat;
+            ++str;
+        }
+        else if(star) {
+            pat = star;
+            str = ++retry;
+        }
+        else {
+            return 0;
+        }
+    }
+
+    while(*pat == '*')
+        ++pat;
+
+    return !*pat;
+}
+
+/* Open a log-style file to add to. Not everything we might be writing to (like
+   dcload's /pc) can append, so fall back to starting a new file if need be. */
+FILE *fopen_append(const char *fn) {
+    FILE *fp;
+
+    if(!(fp = fopen(fn, "a")))
+        fp = fopen(fn, "w");
+
+    return fp;
+}
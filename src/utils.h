@@ -0,0 +1,28 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef UTILS_H
+#define UTILS_H
+
+#include <stdio.h>
+
+void fprint_buf(FILE *fp, const unsigned char *pkt, int len);
+void fprint_hex(FILE *fp, const unsigned char *pkt, int len, int squeeze);
+int glob_match(const char *pat, const char *str);
+FILE *fopen_append(const char *fn);
+
+#endif /* !UTILS_H */
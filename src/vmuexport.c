@@ -0,0 +1,140 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <kos/fs.h>
+
+#include "vmuexport.h"
+#include "utils.h"
+#include "crc.h"
+
+/* Copy every file matching a pattern off of every VMU that's plugged in. The
+   VMUs are all enumerated first, then everything found is streamed out to
+   outdir, named with the VMU it came from (a1_PSO______SYS and so on). A
+   manifest listing the size and CRC-32 of each file is written alongside. */
+
+#define MAX_FILES   256
+
+typedef struct vmu_file {
+    char path[32];
+    char out[16 + 32];
+} vmu_file_t;
+
+static vmu_file_t files[MAX_FILES];
+static uint8_t buf[8192];
+
+static int find_files(const char *pattern) {
+    file_t d;
+    dirent_t *ent;
+    char path[16];
+    int port, unit, n = 0;
+
+    for(port = 0; port < 4; ++port) {
+        for(unit = 1; unit <= 2; ++unit) {
+            sprintf(path, "/vmu/%c%d", 'a' + port, unit);
+
+            if((d = fs_open(path, O_RDONLY | O_DIR)) < 0)
+                continue;
+
+            while((ent = fs_readdir(d)) && n < MAX_FILES) {
+                if(!glob_match(pattern, ent->name) ||
+                   strlen(ent->name) > 12)
+                    continue;
+
+                sprintf(files[n].path, "%s/%s", path, ent->name);
+                sprintf(files[n].out, "%c%d_%s", 'a' + port, unit, ent->name);
+                ++n;
+            }
+
+            fs_close(d);
+        }
+    }
+
+    return n;
+}
+
+static int export_file(const vmu_file_t *f, const char *outdir, FILE *man) {
+    file_t fh;
+    FILE *fp;
+    char fn[256];
+    ssize_t rv;
+    uint32_t crc = 0;
+    int total = 0;
+
+    if((fh = fs_open(f->path, O_RDONLY)) < 0) {
+        printf("Cannot open %s\n", f->path);
+        return -1;
+    }
+
+    sprintf(fn, "%s/%s", outdir, f->out);
+
+    if(!(fp = fopen(fn, "wb"))) {
+        printf("Cannot open %s\n", fn);
+        fs_close(fh);
+        return -1;
+    }
+
+    while((rv = fs_read(fh, buf, sizeof(buf))) > 0) {
+        crc = crc32(crc, buf, (int)rv);
+        total += (int)rv;
+
+        if(fwrite(buf, 1, rv, fp) != (size_t)rv) {
+            rv = -1;
+            break;
+        }
+    }
+
+    fs_close(fh);
+
+    if(fclose(fp) || rv < 0) {
+        printf("Error copying %s\n", f->path);
+        return -1;
+    }
+
+    fprintf(man, "%s %d %08X\n", f->path, total, (unsigned int)crc);
+    return 0;
+}
+
+/* Returns the number of files exported, or -1 if nothing could be written. */
+int vmu_export(const char *pattern, const char *outdir, vmu_export_cb_t cb,
+               void *d) {
+    FILE *man;
+    char fn[256];
+    int i, n, done = 0;
+
+    n = find_files(pattern);
+
+    sprintf(fn, "%s/vmu_manifest.txt", outdir);
+    if(!(man = fopen(fn, "w"))) {
+        printf("Cannot open %s\n", fn);
+        return -1;
+    }
+
+    for(i = 0; i < n; ++i) {
+        if(cb)
+            cb(files[i].path, d);
+
+        if(!export_file(&files[i], outdir, man))
+            ++done;
+    }
+
+    fclose(man);
+    return done;
+}
@@ -0,0 +1,27 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VMUEXPORT_H
+#define VMUEXPORT_H
+
+/* Called before each file is exported, with its full path on the VMU. */
+typedef void (*vmu_export_cb_t)(const char *path, void *d);
+
+int vmu_export(const char *pattern, const char *outdir, vmu_export_cb_t cb,
+               void *d);
+
+#endif /* !VMUEXPORT_H */
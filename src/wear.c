@@ -0,0 +1,79 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "flashrom.h"
+#include "wear.h"
+#include "utils.h"
+
+/* The 8 byte unique ID of the console, in the system partition. */
+#define SYSID_OFFSET    0x1A056
+#define SYSID_LEN       8
+
+/* Hash the system ID down to something short with 32-bit FNV-1a, so that the
+   ledger can tell consoles apart without carrying their IDs around. */
+int wear_console_id(uint32_t *id) {
+    uint8_t sysid[SYSID_LEN];
+    uint32_t h = 2166136261U;
+    int i;
+
+    if(flash_read(SYSID_OFFSET, sysid, SYSID_LEN) < 0)
+        return -1;
+
+    for(i = 0; i < SYSID_LEN; ++i) {
+        h = (h ^ sysid[i]) * 16777619U;
+    }
+
+    *id = h;
+    return 0;
+}
+
+int wear_append(const char *fn, const flash_stats_t *st) {
+    const flash_op_stats_t *e = &st->op[FLASH_OP_ERASE];
+    const flash_op_stats_t *w = &st->op[FLASH_OP_WRITE];
+    const flash_op_stats_t *r = &st->op[FLASH_OP_READ];
+    uint32_t id;
+    FILE *fp;
+    int rv;
+
+    if(wear_console_id(&id))
+        return -1;
+
+    if(!(fp = fopen_append(fn))) {
+        printf("Cannot open wear ledger %s\n", fn);
+        return -1;
+    }
+
+    rv = fprintf(fp, "%08" PRIX32 " %lu %" PRIu32 " %" PRIu32 " %" PRIu64
+                 " %" PRIu32 " %" PRIu32 " %" PRIu32 " %" PRIu64 " %" PRIu32
+                 " %" PRIu32 " %" PRIu32 " %" PRIu64 " %" PRIu32 " %" PRIu32
+                 "\n", id, (unsigned long)time(NULL), e->count, e->bytes,
+                 e->us, e->max_us, w->count, w->bytes, w->us, w->max_us,
+                 r->count, r->bytes, r->us, r->max_us,
+                 e->errors + w->errors + r->errors);
+
+    if(fclose(fp) || rv < 0) {
+        printf("Error writing wear ledger %s\n", fn);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,37 @@
+/*
+    This file is part of Sylverant Flashrom Tool
+    Copyright (C) 2018 Lawrence Sebald
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 3 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WEAR_H
+#define WEAR_H
+
+#include <stdint.h>
+
+#include "flashrom.h"
+
+/* The wear ledger is a text file with one line appended per session that did
+   anything to the flash, so it's easy to pick apart with the usual tools. Each
+   line holds space separated fields:
+     console time erases erase_bytes erase_us erase_max_us
+     writes write_bytes write_us write_max_us reads read_bytes read_us
+     read_max_us errors
+   where console is a hash of the console's system ID (in hex), time is in
+   seconds since the epoch, and the rest come from flash_get_stats. */
+
+int wear_console_id(uint32_t *id);
+int wear_append(const char *fn, const flash_stats_t *st);
+
+#endif /* !WEAR_H */